@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "solver.hpp"
+
+#define FLUSH_SIZE 4096
+
+///every worker owns a range of deal numbers and takes them one at a time
+///from the front, an idle worker steals the back half of the largest
+///remaining range
+struct Worker {
+    std::mutex mutex;
+    unsigned long begin;
+    unsigned long end;
+};
+
+struct Totals {
+    std::mutex mutex;
+    unsigned long counts[3] = {};
+    uint64_t nodes = 0;
+};
+
+static std::mutex output_mutex;
+
+static bool next(std::vector<std::unique_ptr<Worker>> &workers, unsigned self, unsigned long &number) {
+    Worker &own = *workers[self];
+    {
+        std::lock_guard lock(own.mutex);
+        if (own.begin < own.end) {
+            number = own.begin++;
+            return true;
+        }
+    }
+    while (true) {
+        unsigned victim = self;
+        unsigned long most = 0;
+        for (unsigned i = 0; i < workers.size(); ++i) {
+            //the range may shrink again before both locks are held below
+            std::lock_guard lock(workers[i]->mutex);
+            unsigned long left = workers[i]->end - workers[i]->begin;
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (most == 0) {
+            return false;
+        }
+        Worker &other = *workers[victim];
+        std::scoped_lock lock(own.mutex, other.mutex);
+        unsigned long left = other.end - other.begin;
+        if (left == 0) continue;
+        unsigned long mid = other.begin + left / 2;
+        own.begin = mid;
+        own.end = other.end;
+        other.end = mid;
+        number = own.begin++;
+        return true;
+    }
+}
+
+static void work(
+        std::vector<std::unique_ptr<Worker>> &workers,
+        unsigned self,
+        size_t table_bytes,
+        uint64_t node_limit,
+        Totals &totals)
+{
+    Solver solver(table_bytes, node_limit);
+    std::string out;
+    unsigned long counts[3] = {};
+    uint64_t nodes = 0;
+    unsigned long number;
+    while (next(workers, self, number)) {
+        Position position;
+        position.deal((uint64_t)number);
+        auto start = std::chrono::steady_clock::now();
+        Solver::Result result = solver.solve(position);
+        auto end = std::chrono::steady_clock::now();
+        long long usecs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        char line[128];
+        snprintf(line, sizeof(line), "%lu,%s,%llu,%lld,%zu\n",
+                number, resultName(result), (unsigned long long)solver.getNodes(),
+                usecs, solver.getSolution().size());
+        out += line;
+        ++counts[(int)result];
+        nodes += solver.getNodes();
+        if (out.size() >= FLUSH_SIZE) {
+            std::lock_guard lock(output_mutex);
+            fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    }
+    {
+        std::lock_guard lock(output_mutex);
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+    std::lock_guard lock(totals.mutex);
+    for (unsigned i = 0; i < 3; ++i) {
+        totals.counts[i] += counts[i];
+    }
+    totals.nodes += nodes;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s first last [--threads N] [--table-mb N] [--nodes N]\n"
+                    "solves the deals first..last-1 and prints\n"
+                    "deal,result,nodes,usecs,solution_length per deal in no particular order\n"
+                    "--nodes 0 never gives up on a deal, the default is 5000000\n",
+                    name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t table_mb = 64;
+    uint64_t node_limit = 5000000;
+    std::vector<unsigned long> range;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = std::max(strtoul(argv[++i], nullptr, 10), 1ul);
+        } else if (!strcmp(argv[i], "--table-mb") && i + 1 < argc) {
+            table_mb = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+            node_limit = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-') {
+            range.push_back(strtoul(argv[i], nullptr, 10));
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (range.size() != 2 || range[0] > range[1]) {
+        usage(argv[0]);
+    }
+    std::vector<std::unique_ptr<Worker>> workers;
+    unsigned long first = range[0];
+    unsigned long count = range[1] - range[0];
+    for (unsigned i = 0; i < threads; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->begin = first + count * i / threads;
+        worker->end = first + count * (i + 1) / threads;
+        workers.push_back(std::move(worker));
+    }
+    Totals totals;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; ++i) {
+        pool.emplace_back(work, std::ref(workers), i, table_mb << 20, node_limit, std::ref(totals));
+    }
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    fprintf(stderr, "%lu deals, %lu winnable, %lu unwinnable, %lu unknown, "
+                    "%llu nodes in %.3fs on %u threads\n",
+            count,
+            totals.counts[(int)Solver::Result::Winnable],
+            totals.counts[(int)Solver::Result::Unwinnable],
+            totals.counts[(int)Solver::Result::Unknown],
+            (unsigned long long)totals.nodes,
+            std::chrono::duration<double>(end - start).count(),
+            threads);
+    return 0;
+}
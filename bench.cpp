@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "rules.hpp"
+
+#define NUM_POSITIONS 10000
+#define NUM_PAIRS     (1 << 16)
+#define NUM_DEALS     10000
+///untimed runs first, so that caches, branch predictors and the clock
+///frequency have settled
+#define WARMUP        3
+///timed runs, the median of which is reported
+#define REPETITIONS   15
+///games in the journal of the Statistic::load benchmark, one less than
+///load folds into the snapshot
+#define JOURNAL_GAMES 255
+///games recorded in each run of the Statistic::record benchmark
+#define RECORD_GAMES  32
+
+struct Result {
+    std::string name;
+    unsigned long ops;
+    unsigned repetitions;
+    ///ns per operation over the repetitions
+    double median;
+    double min;
+    double max;
+};
+
+static std::vector<Result> results;
+///everything the benchmarks compute ends up here, so none of it is optimized away
+static unsigned long long sink;
+
+///runs body, which does ops operations and returns a value to keep, warmup
+///times and then repetitions times on the clock
+template<typename F>
+static void bench(const char *name, unsigned long ops, F body,
+        unsigned repetitions = REPETITIONS, unsigned warmup = WARMUP)
+{
+    for (unsigned r = 0; r < warmup; ++r) {
+        sink += body();
+    }
+    std::vector<double> ns(repetitions);
+    for (double &time : ns) {
+        auto start = std::chrono::steady_clock::now();
+        sink += body();
+        auto end = std::chrono::steady_clock::now();
+        time = std::chrono::duration<double, std::nano>(end - start).count() / ops;
+    }
+    std::sort(ns.begin(), ns.end());
+    Result &result = results.emplace_back(name, ops, repetitions, ns[ns.size() / 2], ns.front(), ns.back());
+    printf("%-22s %10.2f ns/op  (min %.2f, max %.2f, %lu ops)\n",
+            result.name.c_str(), result.median, result.min, result.max, ops);
+}
+
+///positions from random games, so that they are spread over all stages
+static std::vector<Position> samplePositions() {
+    std::vector<Position> positions;
+    Random random(0);
+    uint64_t number = 0;
+    while (positions.size() < NUM_POSITIONS) {
+        Position position;
+        position.deal(number++);
+        MoveList moves;
+        for (unsigned i = 0; i < 200 && positions.size() < NUM_POSITIONS; ++i) {
+            positions.push_back(position);
+            position.generateMoves(moves);
+            if (moves.size() == 0) break;
+            position.apply(moves[random.below(moves.size())]);
+        }
+    }
+    return positions;
+}
+
+///what fits computed before the tables
+static bool fitsArithmetic(char a, char b) {
+    return a / CARDS_PER_SUIT == b / CARDS_PER_SUIT
+        && ((a + 1) % CARDS_PER_SUIT == b % CARDS_PER_SUIT
+                || (b + 1) % CARDS_PER_SUIT == a % CARDS_PER_SUIT);
+}
+
+static void benchRules() {
+    //about a quarter of the pairs fit, too many to predict the answer
+    std::vector<char> a(NUM_PAIRS), b(NUM_PAIRS);
+    Random random(0);
+    for (unsigned i = 0; i < NUM_PAIRS; ++i) {
+        a[i] = random.below(NUM_CARDS);
+        b[i] = random.below(4) ? random.below(NUM_CARDS) : CARD_INFO[a[i]].next;
+    }
+    bench("fits (math)", NUM_PAIRS, [&] {
+        unsigned long total = 0;
+        for (unsigned i = 0; i < NUM_PAIRS; ++i) {
+            total += fitsArithmetic(a[i], b[i]);
+        }
+        return total;
+    });
+    bench("fits (table)", NUM_PAIRS, [&] {
+        unsigned long total = 0;
+        for (unsigned i = 0; i < NUM_PAIRS; ++i) {
+            total += fits(a[i], b[i]);
+        }
+        return total;
+    });
+
+    std::vector<Position> positions = samplePositions();
+    //every length from the top of every row that isn't empty
+    std::vector<std::pair<const Position *, std::pair<Place, unsigned>>> runs;
+    for (const Position &position : positions) {
+        for (char i = 0; i < NUM_ROWS; ++i) {
+            for (unsigned size = 1; size <= position.size(Row(i)); ++size) {
+                runs.push_back({&position, {Row(i), size}});
+            }
+        }
+    }
+    bench("isRun", runs.size(), [&] {
+        unsigned long total = 0;
+        for (auto &[position, run] : runs) {
+            total += position->isRun(run.first, run.second);
+        }
+        return total;
+    });
+
+    bench("generateMoves", positions.size(), [&] {
+        MoveList moves;
+        unsigned long total = 0;
+        for (const Position &position : positions) {
+            position.generateMoves(moves);
+            total += moves.size();
+        }
+        return total;
+    });
+
+    //a legal move of every position that has one, made and taken back
+    std::vector<Board> boards;
+    std::vector<Move> moves;
+    Random pick(1);
+    for (const Position &position : positions) {
+        MoveList legal;
+        position.generateMoves(legal);
+        if (legal.size() == 0) continue;
+        boards.emplace_back().resume(0, position, {});
+        moves.push_back(legal[pick.below(legal.size())]);
+    }
+    bench("tryMove + undo", boards.size(), [&] {
+        unsigned long total = 0;
+        for (size_t i = 0; i < boards.size(); ++i) {
+            total += boards[i].tryMove(moves[i]);
+            total += boards[i].undo().has_value();
+        }
+        return total;
+    });
+
+    bench("deal", NUM_DEALS, [] {
+        Board board;
+        unsigned long total = 0;
+        for (uint64_t number = 0; number < NUM_DEALS; ++number) {
+            board.deal(number);
+            total += board.getHash();
+        }
+        return total;
+    });
+}
+
+///a game of every kind the statistics tell apart
+static GameRecord sampleGame(Random &random) {
+    GameRecord record = {};
+    record.deal = random.next();
+    record.finished = 1700000000 + random.below(30 * 24 * 60 * 60);
+    record.duration_ms = 60000 + random.below(20 * 60000);
+    record.moves = 80 + random.below(200);
+    record.real_moves = record.moves + random.below(200);
+    record.config.consider_undo_wins = random.below(2);
+    record.won = random.below(3) != 0;
+    record.used_undo = random.below(4) == 0;
+    return record;
+}
+
+///runs body in an empty directory of its own, since Statistic reads and
+///writes its files in the working directory
+template<typename F>
+static void inTempDir(const char *name, F body) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::filesystem::path cwd = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+    body();
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+}
+
+static void benchStatistic() {
+    Random random(2);
+    Config config;
+    //every record is synced to the disk, so each run records only a few
+    //games; appending doesn't slow down as the journal grows
+    inTempDir("little-napoleon-bench-record", [&] {
+        Statistic stats;
+        stats.load(config);
+        bench("Statistic::record", RECORD_GAMES, [&] {
+            for (unsigned i = 0; i < RECORD_GAMES; ++i) {
+                stats.record(sampleGame(random));
+            }
+            return stats.wins;
+        });
+    });
+    inTempDir("little-napoleon-bench-load", [&] {
+        {
+            //a snapshot that has seen a lot of games
+            Statistic stats;
+            stats.load(config);
+            for (unsigned i = 0; i < JOURNAL_GAMES + 1; ++i) {
+                stats.record(sampleGame(random));
+            }
+        }
+        {
+            //folds them into the snapshot, then a full journal
+            Statistic stats;
+            stats.load(config);
+            for (unsigned i = 0; i < JOURNAL_GAMES; ++i) {
+                stats.record(sampleGame(random));
+            }
+        }
+        printf("%-22s %10llu bytes, journal %llu bytes\n", "  snapshot",
+                (unsigned long long)std::filesystem::file_size(SNAPSHOT_FILE),
+                (unsigned long long)std::filesystem::file_size(JOURNAL_FILE));
+        bench("Statistic::load", 1, [&] {
+            Statistic stats;
+            stats.load(config);
+            return stats.wins;
+        });
+    });
+}
+
+static bool writeJson(const char *filename) {
+    FILE *f = std::fopen(filename, "w");
+    if (!f) return false;
+    fprintf(f, "{\n  \"warmup\": %d,\n  \"benchmarks\": [\n", WARMUP);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"ops\": %lu, \"repetitions\": %u, "
+                   "\"ns_per_op\": %.3f, \"min\": %.3f, \"max\": %.3f}%s\n",
+                result.name.c_str(), result.ops, result.repetitions, result.median, result.min, result.max,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return std::fclose(f) == 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--json FILE] [--no-io]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *json = nullptr;
+    bool io = true;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json = argv[++i];
+        } else if (!strcmp(argv[i], "--no-io")) {
+            io = false;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    benchRules();
+    if (io) {
+        benchStatistic();
+    }
+    if (json && !writeJson(json)) {
+        fprintf(stderr, "failed to write %s\n", json);
+        return 1;
+    }
+    //never true, but the compiler can't know
+    return sink == 42 ? 2 : 0;
+}
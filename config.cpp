@@ -8,15 +8,23 @@
 #include <iostream>
 #include <string>
 #include <charconv>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <optional>
 #include "config.hpp"
+#include "storage.hpp"
 
 #define ENABLE_UNDO "allow_undo"
 #define NUM_CONS_UNDOS_ALLOW "number_of_consecutive_undos_without_counting_as_undo_used"
 #define CONSIDER_UNDO_WINS "consider_undo_used_wins_in_statistic"
 #define CLOSE_IS_LOSS "closing_running_game_counts_as_loss"
 #define REAL_MOVES "count_real_moves"
+#define IDLE_RENDERING "redraw_only_on_input"
 
 const char *whitespace = "\t\r\n ";
 
@@ -77,6 +85,8 @@ void Config::parse(const char *filename) {
             close_is_loss = parseBool(rhs);
         } else if (lhs == REAL_MOVES) {
             real_moves = parseBool(rhs);
+        } else if (lhs == IDLE_RENDERING) {
+            idle_rendering = parseBool(rhs);
         } else {
             throw std::runtime_error("invalid setting");
         }
@@ -87,71 +97,435 @@ void Config::parse(const char *filename) {
                NUM_CONS_UNDOS_ALLOW " = 1\n"
                CONSIDER_UNDO_WINS " = false\n"
                CLOSE_IS_LOSS " = false\n"
-               REAL_MOVES " = true\n";
+               REAL_MOVES " = true\n"
+               IDLE_RENDERING " = true\n";
     }
 }
 
-void Statistic::load(const char *filename, const Config &config) {
-    FILE *f = std::fopen(filename, "r");
+#define JOURNAL_MAGIC  "LNSJ"
+#define SNAPSHOT_MAGIC "LNSS"
+///version 2 keeps when games ended and the spread of the wins
+#define STATS_VERSION  2
+#define HEADER_SIZE    16
+#define RECORD_SIZE    32
+///games in the journal before it is folded into the snapshot at startup
+#define COMPACT_AFTER  256
+#define SECS_PER_DAY   (24 * 60 * 60)
+
+static void putHeader(unsigned char *p, const char *magic, uint64_t generation) {
+    std::memcpy(p, magic, 4);
+    p += 4;
+    put(p, STATS_VERSION, 4);
+    put(p, generation, 8);
+}
+
+///the generation, if the header is one of ours
+static std::optional<uint64_t> getHeader(const unsigned char *p, const char *magic, unsigned &version) {
+    if (std::memcmp(p, magic, 4)) return {};
+    p += 4;
+    version = get(p, 4);
+    if (version < 1 || version > STATS_VERSION) return {};
+    return get(p, 8);
+}
+
+static unsigned char configBits(const Config &config) {
+    return config.enable_undo
+        | config.consider_undo_wins << 1
+        | config.close_is_loss << 2
+        | config.real_moves << 3;
+}
+
+static void configFromBits(Config &config, unsigned char bits) {
+    config.enable_undo = bits & 1;
+    config.consider_undo_wins = bits & 2;
+    config.close_is_loss = bits & 4;
+    config.real_moves = bits & 8;
+}
+
+static void encode(const GameRecord &record, unsigned char *p) {
+    unsigned char *begin = p;
+    put(p, record.deal, 8);
+    put(p, record.duration_ms, 4);
+    put(p, record.moves, 4);
+    put(p, record.real_moves, 4);
+    put(p, record.config.num_cons_undos_allow, 1);
+    put(p, configBits(record.config), 1);
+    put(p, record.won | record.used_undo << 1, 1);
+    put(p, record.finished, 4);
+    put(p, 0, 1);
+    put(p, checksum(begin, RECORD_SIZE - 4), 4);
+}
+
+static bool decode(const unsigned char *p, GameRecord &record) {
+    const unsigned char *begin = p;
+    record.deal = get(p, 8);
+    record.duration_ms = get(p, 4);
+    record.moves = get(p, 4);
+    record.real_moves = get(p, 4);
+    record.config.num_cons_undos_allow = get(p, 1);
+    configFromBits(record.config, get(p, 1));
+    unsigned flags = get(p, 1);
+    record.won = flags & 1;
+    record.used_undo = flags & 2;
+    //0 in games of version 1
+    record.finished = get(p, 4);
+    p += 1;
+    return get(p, 4) == checksum(begin, RECORD_SIZE - 4);
+}
+
+static void putSketch(std::vector<unsigned char> &data, const Sketch &sketch) {
+    append(data, sketch.getFirst(), 2);
+    append(data, sketch.getBuckets().size(), 2);
+    for (uint32_t count : sketch.getBuckets()) {
+        append(data, count, 4);
+    }
+}
+
+static Sketch getSketch(Reader &in) {
+    unsigned first = in.get(2);
+    std::vector<uint32_t> counts(in.get(2));
+    for (uint32_t &count : counts) {
+        count = in.get(4);
+    }
+    return Sketch(first, std::move(counts));
+}
+
+static void putDistribution(std::vector<unsigned char> &data, const Distribution &distribution) {
+    putSketch(data, distribution.moves);
+    putSketch(data, distribution.real_moves);
+    putSketch(data, distribution.duration_ms);
+}
+
+static Distribution getDistribution(Reader &in) {
+    Distribution distribution;
+    distribution.moves = getSketch(in);
+    distribution.real_moves = getSketch(in);
+    distribution.duration_ms = getSketch(in);
+    return distribution;
+}
+
+void Distribution::add(const GameRecord &record) {
+    moves.add(record.moves);
+    real_moves.add(record.real_moves);
+    duration_ms.add(record.duration_ms);
+}
+
+void Distribution::merge(const Distribution &other) {
+    moves.merge(other.moves);
+    real_moves.merge(other.real_moves);
+    duration_ms.merge(other.duration_ms);
+}
+
+Statistic::WinLoss &Statistic::findWinLoss(const Config &config) {
+    for (WinLoss &entry : winloss) {
+        if (entry.enable_undo == config.enable_undo
+                && entry.num_cons_undos_allow == config.num_cons_undos_allow
+                && entry.consider_undo_wins == config.consider_undo_wins
+                && entry.close_is_loss == config.close_is_loss)
+        {
+            return entry;
+        }
+    }
+    return winloss.emplace_back(
+            config.enable_undo,
+            config.num_cons_undos_allow,
+            config.consider_undo_wins,
+            config.close_is_loss,
+            0,
+            0);
+}
+
+Statistic::Moves &Statistic::findMoves(bool real_moves) {
+    for (Moves &entry : moves) {
+        if (entry.real_moves == real_moves) return entry;
+    }
+    return moves.emplace_back(real_moves, 0, 0);
+}
+
+///counts a game the way the config it was played with says
+void Statistic::apply(const GameRecord &record) {
+    WinLoss &entry = findWinLoss(record.config);
+    if (!record.won) {
+        ++entry.losses;
+    } else if (!record.used_undo || record.config.consider_undo_wins) {
+        ++entry.wins;
+        Moves &moves = findMoves(record.config.real_moves);
+        ++moves.wins;
+        moves.total += record.config.real_moves ? record.real_moves : record.moves;
+        entry.all.add(record);
+        if (entry.recent.size() < RECENT_GAMES) {
+            entry.recent.push_back(record);
+        } else {
+            entry.recent[entry.next_recent] = record;
+            entry.next_recent = (entry.next_recent + 1) % RECENT_GAMES;
+        }
+        //games of version 1 don't know their day
+        if (record.finished) {
+            uint32_t day = record.finished / SECS_PER_DAY;
+            Day &slot = entry.days[day % RECENT_DAYS];
+            if (slot.day < day) {
+                slot = {day, {}};
+            }
+            if (slot.day == day) {
+                slot.wins.add(record);
+            }
+        }
+    }
+}
+
+void Statistic::update() {
+    WinLoss &entry = findWinLoss(config);
+    wins = entry.wins;
+    losses = entry.losses;
+    Moves &moves = findMoves(config.real_moves);
+    moves_avg = moves.wins ? (float)moves.total / moves.wins : 0;
+    spread_all = entry.all;
+    spread_games = {};
+    for (const GameRecord &record : entry.recent) {
+        spread_games.add(record);
+    }
+    spread_days = {};
+    uint32_t today = std::time(nullptr) / SECS_PER_DAY;
+    for (const Day &slot : entry.days) {
+        if (slot.day + RECENT_DAYS > today && slot.day <= today) {
+            spread_days.merge(slot.wins);
+        }
+    }
+}
+
+///the totals of the old stats.sav, which only knew the average of the moves
+void Statistic::importLegacy(const char *filename) {
+    struct Entry {
+        enum class Type { Move, WinLoss };
+        Type t;
+        union {
+            struct {
+                bool enable_undo;
+                unsigned char num_cons_undos_allow;
+                bool consider_undo_wins;
+                bool close_is_loss;
+
+                uint32_t wins;
+                uint32_t losses;
+            };
+            struct {
+                bool real_moves;
+
+                float moves_avg;
+            };
+        };
+    };
+    FILE *f = std::fopen(filename, "rb");
     if (!f) return;
+    std::vector<Entry> entries;
     Entry entry;
-    int i = 0;
+    uint32_t total_wins = 0;
     while (std::fread(&entry, sizeof(entry), 1, f) == 1) {
         entries.push_back(entry);
-        using enum Entry::Type;
-        if (entry.t == Move && entry.matchesMove(config)) {
-            assert(moves_idx == -1);
-            moves_avg = entry.moves_avg;
-            moves_idx = i;
-        } else if (entry.t == WinLoss && entry.matchesWinLoss(config)) {
-            assert(winloss_idx == -1);
-            wins = entry.wins;
-            losses = entry.losses;
-            winloss_idx = i;
+        if (entry.t == Entry::Type::WinLoss) {
+            Config key;
+            key.enable_undo = entry.enable_undo;
+            key.num_cons_undos_allow = entry.num_cons_undos_allow;
+            key.consider_undo_wins = entry.consider_undo_wins;
+            key.close_is_loss = entry.close_is_loss;
+            WinLoss &totals = findWinLoss(key);
+            totals.wins += entry.wins;
+            totals.losses += entry.losses;
+            total_wins += entry.wins;
         }
-        ++i;
     }
     std::fclose(f);
+    for (const Entry &entry : entries) {
+        if (entry.t == Entry::Type::Move) {
+            Moves &totals = findMoves(entry.real_moves);
+            totals.wins = total_wins;
+            totals.total = std::llround(entry.moves_avg * total_wins);
+        }
+    }
 }
 
-void Statistic::save(const char *filename, const Config &config) {
-    FILE *f = std::fopen(filename, "w");
-    if (!f) {
-        err(1, "fopen %s", filename);
+bool Statistic::readSnapshot() {
+    std::ifstream file(SNAPSHOT_FILE, std::ios::binary);
+    std::vector<unsigned char> data(std::istreambuf_iterator<char>(file), {});
+    if (data.size() < HEADER_SIZE + 12) return false;
+    const unsigned char *p = data.data() + data.size() - 4;
+    unsigned version;
+    std::optional<uint64_t> gen = getHeader(data.data(), SNAPSHOT_MAGIC, version);
+    if (get(p, 4) != checksum(data.data(), data.size() - 4) || !gen) return false;
+    Reader in = {data.data() + HEADER_SIZE, data.data() + data.size() - 4};
+    //the counts come from the file, so every loop also stops at its end
+    for (unsigned i = in.get(4); i > 0 && !in.failed; --i) {
+        WinLoss entry;
+        entry.num_cons_undos_allow = in.get(1);
+        Config key;
+        configFromBits(key, in.get(1));
+        entry.enable_undo = key.enable_undo;
+        entry.consider_undo_wins = key.consider_undo_wins;
+        entry.close_is_loss = key.close_is_loss;
+        entry.wins = in.get(4);
+        entry.losses = in.get(4);
+        winloss.push_back(entry);
     }
-    if (moves_idx == -1) {
-        entries.emplace_back(
-                Entry::Type::Move,
-                config.real_moves,
-                moves_avg);
-    } else {
-        entries[moves_idx].moves_avg = moves_avg;
-    }
-    if (winloss_idx == -1) {
-        entries.emplace_back(
-                Entry::Type::WinLoss,
-                config.enable_undo,
-                config.num_cons_undos_allow,
-                config.consider_undo_wins,
-                config.close_is_loss,
-                wins,
-                losses);
+    for (unsigned i = in.get(4); i > 0 && !in.failed; --i) {
+        Moves entry;
+        entry.real_moves = in.get(1);
+        entry.wins = in.get(4);
+        entry.total = in.get(8);
+        moves.push_back(entry);
+    }
+    for (WinLoss &entry : winloss) {
+        if (version < 2 || in.failed) break;
+        entry.all = getDistribution(in);
+        for (unsigned i = in.get(2); i > 0 && !in.failed; --i) {
+            GameRecord record = {};
+            record.moves = in.get(4);
+            record.real_moves = in.get(4);
+            record.duration_ms = in.get(4);
+            if (entry.recent.size() < RECENT_GAMES) {
+                entry.recent.push_back(record);
+            } else {
+                entry.recent[entry.next_recent] = record;
+                entry.next_recent = (entry.next_recent + 1) % RECENT_GAMES;
+            }
+        }
+        for (unsigned i = in.get(1); i > 0 && !in.failed; --i) {
+            Day day;
+            day.day = in.get(4);
+            day.wins = getDistribution(in);
+            Day &slot = entry.days[day.day % RECENT_DAYS];
+            if (slot.day < day.day) {
+                slot = std::move(day);
+            }
+        }
+    }
+    //a snapshot that is cut short or goes on past its totals is thrown
+    //away whole, the totals are then rebuilt from the journal
+    if (in.failed || in.p != in.end) {
+        winloss.clear();
+        moves.clear();
+        return false;
+    }
+    generation = *gen;
+    return true;
+}
+
+bool Statistic::readJournal() {
+    std::ifstream file(JOURNAL_FILE, std::ios::binary);
+    std::vector<unsigned char> data(std::istreambuf_iterator<char>(file), {});
+    file.close();
+    if (data.size() < HEADER_SIZE) return false;
+    unsigned version;
+    std::optional<uint64_t> gen = getHeader(data.data(), JOURNAL_MAGIC, version);
+    if (!gen) {
+        throw std::runtime_error("unknown " JOURNAL_FILE);
+    }
+    if (*gen < generation) return false;
+    generation = *gen;
+    size_t size = HEADER_SIZE;
+    GameRecord record;
+    while (size + RECORD_SIZE <= data.size() && decode(&data[size], record)) {
+        apply(record);
+        ++journal_games;
+        size += RECORD_SIZE;
+    }
+    //a record torn by a crash is cut off, so that the next one lines up
+    if (size != data.size()) {
+        std::filesystem::resize_file(JOURNAL_FILE, size);
+    }
+    return true;
+}
+
+void Statistic::openJournal() {
+    journal = std::fopen(JOURNAL_FILE, "ab");
+    if (!journal) {
+        err(1, "fopen %s", JOURNAL_FILE);
+    }
+}
+
+///writes the totals as a snapshot of the next generation and starts an
+///empty journal; a crash in between leaves an old journal, which load
+///ignores and replaces before appending to it
+void Statistic::compact() {
+    std::vector<unsigned char> data(HEADER_SIZE);
+    putHeader(data.data(), SNAPSHOT_MAGIC, generation + 1);
+    append(data, winloss.size(), 4);
+    for (const WinLoss &entry : winloss) {
+        Config key;
+        key.enable_undo = entry.enable_undo;
+        key.consider_undo_wins = entry.consider_undo_wins;
+        key.close_is_loss = entry.close_is_loss;
+        append(data, entry.num_cons_undos_allow, 1);
+        append(data, configBits(key), 1);
+        append(data, entry.wins, 4);
+        append(data, entry.losses, 4);
+    }
+    append(data, moves.size(), 4);
+    for (const Moves &entry : moves) {
+        append(data, entry.real_moves, 1);
+        append(data, entry.wins, 4);
+        append(data, entry.total, 8);
+    }
+    //the spreads, in the order of the totals
+    for (const WinLoss &entry : winloss) {
+        putDistribution(data, entry.all);
+        append(data, entry.recent.size(), 2);
+        for (size_t i = 0; i < entry.recent.size(); ++i) {
+            const GameRecord &record = entry.recent[(entry.next_recent + i) % entry.recent.size()];
+            append(data, record.moves, 4);
+            append(data, record.real_moves, 4);
+            append(data, record.duration_ms, 4);
+        }
+        append(data, RECENT_DAYS, 1);
+        for (const Day &day : entry.days) {
+            append(data, day.day, 4);
+            putDistribution(data, day.wins);
+        }
+    }
+    append(data, checksum(data.data(), data.size()), 4);
+    if (!writeAtomically(SNAPSHOT_FILE, data)) {
+        err(1, "write %s", SNAPSHOT_FILE);
+    }
+    ++generation;
+    std::vector<unsigned char> header(HEADER_SIZE);
+    putHeader(header.data(), JOURNAL_MAGIC, generation);
+    if (!writeAtomically(JOURNAL_FILE, header)) {
+        err(1, "write %s", JOURNAL_FILE);
+    }
+    journal_games = 0;
+}
+
+Statistic::~Statistic() {
+    if (journal) std::fclose(journal);
+}
+
+void Statistic::load(const Config &config) {
+    this->config = config;
+    bool snapshot = readSnapshot();
+    bool fresh = !snapshot && !std::filesystem::exists(JOURNAL_FILE);
+    bool current = false;
+    if (fresh) {
+        importLegacy(STATS_FILE);
     } else {
-        Entry &entry = entries[winloss_idx];
-        entry.wins = wins;
-        entry.losses = losses;
+        current = readJournal();
     }
-    size_t num_entries = entries.size();
-    if (fwrite(entries.data(), sizeof(Entry), num_entries, f) != num_entries) {
-        err(1, "fwrite %s", filename);
+    //games appended to a journal the snapshot already has would be skipped
+    //by every later load, and an unreadable snapshot is replaced
+    if (!snapshot || !current || journal_games >= COMPACT_AFTER) {
+        compact();
     }
-    std::fclose(f);
+    openJournal();
+    update();
 }
 
-void Statistic::recordWin(unsigned moves) {
-        assert(moves > 0);
-        moves_avg = ((moves_avg * wins) + moves) / (wins + 1);
-        ++wins;
+void Statistic::record(const GameRecord &record) {
+    unsigned char data[RECORD_SIZE];
+    encode(record, data);
+    if (std::fwrite(data, 1, RECORD_SIZE, journal) != RECORD_SIZE || !sync(journal)) {
+        err(1, "fwrite %s", JOURNAL_FILE);
+    }
+    ++journal_games;
+    apply(record);
+    update();
 }
 
 void testConfig() {
@@ -162,8 +536,8 @@ void testConfig() {
         printf("Error parsing config: %s\n", e.what());
     }
     Statistic stats;
-    stats.load(STATS_FILE, config);
-    stats.save(STATS_FILE, config);
+    stats.load(config);
+    printf("%u wins %u losses %f moves\n", stats.wins, stats.losses, stats.moves_avg);
     printf("%u %u %u %u %u",
             config.enable_undo,
             config.num_cons_undos_allow,
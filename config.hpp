@@ -1,8 +1,16 @@
 #include <cstdint>
+#include <array>
+#include <cstdio>
 #include <vector>
+#include "sketch.hpp"
 
 #define CONFIG_FILE "config.txt"
 #define STATS_FILE "stats.sav"
+#define JOURNAL_FILE "stats.log"
+#define SNAPSHOT_FILE "stats.snap"
+///the rolling windows of the statistics
+#define RECENT_GAMES  100
+#define RECENT_DAYS   7
 
 struct Config {
     bool enable_undo = true;
@@ -10,76 +18,102 @@ struct Config {
     bool consider_undo_wins = false;
     bool close_is_loss = true;
     bool real_moves = true;
+    ///redraw only on input and timer ticks instead of at a steady frame rate
+    bool idle_rendering = true;
 
     void parse(const char *filename);
 };
 
-class Statistic {
-    struct Entry {
-        enum class Type { Move, WinLoss };
-        Type t;
-        union {
-            struct {
-                bool enable_undo;
-                unsigned char num_cons_undos_allow;
-                bool consider_undo_wins;
-                bool close_is_loss;
-
-                uint32_t wins;
-                uint32_t losses;
-            };
-            struct {
-                bool real_moves;
-
-                float moves_avg;
-            };
-        };
+///one finished game, as it is kept in the journal
+struct GameRecord {
+    uint64_t deal;
+    ///seconds since the epoch when it ended
+    uint32_t finished;
+    uint32_t duration_ms;
+    uint32_t moves;
+    uint32_t real_moves;
+    ///the settings the game was played with, only those that decide how it counts
+    Config config;
+    bool won;
+    bool used_undo;
+};
 
-        Entry() = default;
+///how the counted wins of a config spread out
+struct Distribution {
+    Sketch moves;
+    Sketch real_moves;
+    Sketch duration_ms;
 
-        Entry(Type t, bool real_moves, float moves_avg)
-            : t(t)
-            , real_moves(real_moves)
-            , moves_avg(moves_avg) {}
+    void add(const GameRecord &record);
+    void merge(const Distribution &other);
+};
 
-        Entry(Type t,
-                bool enable_undo,
-                char num_cons_undos_allow,
-                bool consider_undo_wins,
-                bool close_is_loss,
-                uint32_t wins,
-                uint32_t losses)
-            : t(t)
-            , enable_undo(enable_undo)
-            , num_cons_undos_allow(num_cons_undos_allow)
-            , consider_undo_wins(consider_undo_wins)
-            , close_is_loss(close_is_loss)
-            , wins(wins)
-            , losses(losses) {}
+///wins, losses and average moves under the current config, rebuilt at startup
+///from a snapshot of the totals and a journal of the games finished since;
+///every game is appended to the journal and synced to disk as it ends
+class Statistic {
+    struct Day {
+        ///days since the epoch
+        uint32_t day = 0;
+        Distribution wins;
+    };
 
-        constexpr bool matchesMove(const Config &config) {
-            return config.real_moves == real_moves;
-        }
+    struct WinLoss {
+        bool enable_undo;
+        unsigned char num_cons_undos_allow;
+        bool consider_undo_wins;
+        bool close_is_loss;
+        uint32_t wins;
+        uint32_t losses;
+        Distribution all;
+        ///the last RECENT_GAMES counted wins, recent[next_recent] is the
+        ///oldest once it is full
+        std::vector<GameRecord> recent;
+        unsigned next_recent = 0;
+        ///one slot per day of the week, a slot is reused a week later
+        std::array<Day, RECENT_DAYS> days;
+    };
 
-        constexpr bool matchesWinLoss(const Config &config) {
-            return config.enable_undo == enable_undo
-                && config.num_cons_undos_allow == num_cons_undos_allow
-                && config.consider_undo_wins == consider_undo_wins
-                && config.close_is_loss == close_is_loss;
-        }
+    struct Moves {
+        bool real_moves;
+        uint32_t wins;
+        uint64_t total;
     };
 
-    std::vector<Entry> entries;
-    int winloss_idx = -1;
-    int moves_idx = -1;
+    std::vector<WinLoss> winloss;
+    std::vector<Moves> moves;
+    ///the snapshot and the journal whose games it doesn't contain yet share
+    ///a generation, a journal of an older generation is already in the snapshot
+    uint64_t generation = 0;
+    unsigned journal_games = 0;
+    FILE *journal = nullptr;
+    Config config;
+
+    WinLoss &findWinLoss(const Config &config);
+    Moves &findMoves(bool real_moves);
+    void apply(const GameRecord &record);
+    void update();
+    void importLegacy(const char *filename);
+    ///false if there is none or it is cut short or damaged
+    bool readSnapshot();
+    ///whether the journal belongs to the snapshot, otherwise it is ignored
+    bool readJournal();
+    void openJournal();
+    void compact();
 
 public:
     uint32_t wins = 0;
     uint32_t losses = 0;
     float moves_avg = 0;
+    ///the counted wins under the current config: all of them, the last
+    ///RECENT_GAMES and those of the last RECENT_DAYS days
+    Distribution spread_all;
+    Distribution spread_games;
+    Distribution spread_days;
+
+    ~Statistic();
 
-    void load(const char *filename, const Config &config);
-    void save(const char *filename, const Config &config);
-    void recordWin(unsigned moves);
-    void recordLoss() { ++losses; }
+    void load(const Config &config);
+    ///appends record to the journal and counts it
+    void record(const GameRecord &record);
 };
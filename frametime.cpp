@@ -0,0 +1,78 @@
+#include <algorithm>
+#include "frametime.hpp"
+
+#ifdef FRAME_STATS
+
+static const char *SERIES_NAMES[] = {
+    "events", "select", "move", "layout", "draw", "display", "frame", "latency",
+};
+
+static uint32_t micros(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+FrameStats::FrameStats(const char *filename) {
+    csv = std::fopen(filename, "w");
+    if (csv) {
+        std::fputs("events_us,select_us,move_us,layout_us,draw_us,display_us,frame_us,latency_us\n", csv);
+    }
+}
+
+FrameStats::~FrameStats() {
+    if (csv) std::fclose(csv);
+}
+
+void FrameStats::count(unsigned series, uint32_t us) {
+    sketches[series].add(us);
+    max[series] = std::max(max[series], us);
+}
+
+void FrameStats::beginFrame() {
+    spent = {};
+    frame_start = clock::now();
+}
+
+void FrameStats::input() {
+    if (!input_time) {
+        input_time = clock::now();
+    }
+}
+
+void FrameStats::present() {
+    clock::time_point now = clock::now();
+    for (unsigned phase = 0; phase < NUM_PHASES; ++phase) {
+        uint32_t us = micros(spent[phase]);
+        count(phase, us);
+        if (csv) std::fprintf(csv, "%u,", us);
+    }
+    uint32_t us = micros(now - frame_start);
+    count(NUM_PHASES, us);
+    if (csv) std::fprintf(csv, "%u,", us);
+    //frames without input leave the latency empty
+    if (input_time) {
+        us = micros(now - *input_time);
+        count(NUM_PHASES + 1, us);
+        if (csv) std::fprintf(csv, "%u", us);
+        input_time = {};
+    }
+    if (csv) std::fputc('\n', csv);
+    ++frame;
+}
+
+std::string FrameStats::report() const {
+    char line[64];
+    std::snprintf(line, sizeof(line), "%-8s %6s %6s %6s  %lu frames\n", "us", "p50", "p99", "max", frame);
+    std::string out = line;
+    for (unsigned series = 0; series < NUM_SERIES; ++series) {
+        const Sketch &sketch = sketches[series];
+        //the sketch may round past the largest value
+        std::snprintf(line, sizeof(line), "%-8s %6u %6u %6u\n", SERIES_NAMES[series],
+                std::min(sketch.quantile(0.5), max[series]),
+                std::min(sketch.quantile(0.99), max[series]),
+                max[series]);
+        out += line;
+    }
+    return out;
+}
+
+#endif
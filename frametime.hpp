@@ -0,0 +1,82 @@
+#pragma once
+
+///the parts of a frame that are timed, each including what it calls:
+///handling events includes selecting and moving cards, moving includes
+///laying them out, and display includes waiting for the frame limit
+enum Phase {
+    PHASE_EVENTS,
+    PHASE_SELECT,
+    PHASE_MOVE,
+    PHASE_LAYOUT,
+    PHASE_DRAW,
+    PHASE_DISPLAY,
+    NUM_PHASES,
+};
+
+#ifdef FRAME_STATS
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include "sketch.hpp"
+
+#define FRAME_CSV "frames.csv"
+
+///microseconds spent in each phase of every frame, summed up in sketches and
+///written to a CSV file one frame per line
+class FrameStats {
+    using clock = std::chrono::steady_clock;
+
+    ///the phases, the whole frame, and the latency of input
+    static constexpr unsigned NUM_SERIES = NUM_PHASES + 2;
+
+    std::array<clock::duration, NUM_PHASES> spent = {};
+    clock::time_point frame_start = clock::now();
+    ///when the oldest input not shown yet arrived
+    std::optional<clock::time_point> input_time;
+    std::array<Sketch, NUM_SERIES> sketches;
+    std::array<uint32_t, NUM_SERIES> max = {};
+    unsigned long frame = 0;
+    FILE *csv;
+
+    void count(unsigned series, uint32_t us);
+
+public:
+    explicit FrameStats(const char *filename);
+    ~FrameStats();
+
+    void add(Phase phase, clock::duration duration) {
+        spent[phase] += duration;
+    }
+
+    ///the frame starts after waiting for events
+    void beginFrame();
+    ///an input event arrived just now, SFML doesn't stamp events itself
+    void input();
+    ///the frame is on screen
+    void present();
+    ///p50, p99 and max of every phase so far, one per line
+    std::string report() const;
+};
+
+extern FrameStats frame_stats;
+
+class PhaseTimer {
+    Phase phase;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase) {}
+    ~PhaseTimer() { frame_stats.add(phase, std::chrono::steady_clock::now() - start); }
+};
+
+///times the rest of the enclosing scope as part of phase
+#define TIME_PHASE(phase) PhaseTimer phase_timer(phase)
+
+#else
+
+#define TIME_PHASE(phase)
+
+#endif
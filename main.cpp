@@ -2,8 +2,24 @@
 #include <algorithm>
 #include <random>
 #include <chrono>
-#include <list>
+#include <cmath>
+#include <atomic>
+#include <charconv>
+#include <thread>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
 #include "config.hpp"
+#include "frametime.hpp"
+#include "rules.hpp"
+#include "pack.hpp"
+#include "replay.hpp"
+#include "save.hpp"
+#include "solver.hpp"
 
 #define WINDOW_WIDTH  1200
 #define WINDOW_HEIGHT 800
@@ -14,18 +30,22 @@
 #define ROW_MARGIN    20
 #define FONT_SIZE     25
 
+#define HINT_TABLE_BYTES (32 << 20)
+#define HINT_NODES       5000000
+
+///milliseconds between two moves of a playback, halved or doubled by the keys
+#define PLAYBACK_INTERVAL     250
+#define PLAYBACK_INTERVAL_MIN 15
+#define PLAYBACK_INTERVAL_MAX 4000
+
 #define CARD_WIDTH     222
 #define CARD_HEIGHT    323
-#define CARDS_PER_SUIT 13
-#define NUM_VACANT 11
 #define NSEC_PER_SEC 1000000000
 
-using iterator = std::vector<char>::iterator;
 using chrono_clock = std::chrono::steady_clock;
 using chrono_nsec = std::chrono::nanoseconds;
 using chrono_time_point = std::chrono::time_point<chrono_clock, chrono_nsec>;
 
-const char NUM_CARDS = 4 * CARDS_PER_SUIT;
 const float CARD_WS = CARD_WIDTH * CARD_SCALE + 2 * OUTLINE_WIDTH;
 const float CARD_HS = CARD_HEIGHT * CARD_SCALE + 2 * OUTLINE_WIDTH;
 const float CARD_WR = CARD_WS * 0.25;
@@ -38,28 +58,25 @@ const sf::Color COLOR_SELECT = sf::Color::Blue;
 
 char strbuf[1024];
 
-enum Suit {
-    Clubs,
-    Hearts,
-    Spades,
-    Diamonds,
-};
+#define ATLAS_COLUMNS 8
+#define ATLAS_ROWS    ((NUM_CARDS + ATLAS_COLUMNS) / ATLAS_COLUMNS)
 
-enum FaceCard {
-    King,
-    Ace,
-    Jack = 11,
-    Queen,
-};
+///all card faces in one texture, so that a frame draws every card at once;
+///the cell after the last card is plain white, for the outlines
+sf::Texture atlas;
+
+sf::IntRect atlasCell(unsigned i, sf::Vector2i cell_size) {
+    return {{(int)(i % ATLAS_COLUMNS) * cell_size.x, (int)(i / ATLAS_COLUMNS) * cell_size.y}, cell_size};
+}
 
-struct Card : public sf::Drawable {
+struct Card {
     sf::Sprite sprite;
     char id;
     bool selected;
     bool hovered;
 
-    Card(const sf::Texture &texture, char id) 
-        : sprite(texture)
+    Card(const sf::Texture &texture, sf::IntRect rect, char id)
+        : sprite(texture, rect)
         , id(id)
         , selected(false)
         , hovered(false)
@@ -69,13 +86,6 @@ struct Card : public sf::Drawable {
         return id >= NUM_CARDS;
     }
 
-    constexpr bool fits(const Card &other) {
-        return id / CARDS_PER_SUIT == other.id / CARDS_PER_SUIT
-            && ((id + 1) % CARDS_PER_SUIT == other.id % CARDS_PER_SUIT
-                    || (other.id + 1) % CARDS_PER_SUIT == id % CARDS_PER_SUIT);
-
-    }
-
     sf::Vector2f update(sf::Vector2i delta) {
         sf::Vector2f pos = sprite.getPosition();
         pos.x += delta.x;
@@ -84,81 +94,282 @@ struct Card : public sf::Drawable {
         return pos;
     }
 
-    virtual void draw(sf::RenderTarget &target, sf::RenderStates) const override {
-        if (selected || hovered) {
-            sf::FloatRect bounds = sprite.getGlobalBounds();
-            sf::RectangleShape rect(bounds.size);
-            rect.setFillColor(sf::Color::Transparent);
-            rect.setPosition(bounds.position);
-            rect.setOutlineColor(COLOR_SELECT);
-            rect.setOutlineThickness(selected ? OUTLINE_WIDTH : OUTLINE_WIDTH / 2);
-            target.draw(rect);
+};
+
+///cards and their outlines as triangles textured from the atlas, drawn in
+///a single call
+class CardBatch : public sf::Drawable {
+    sf::VertexArray vertices{sf::PrimitiveType::Triangles};
+
+    void quad(sf::FloatRect rect, sf::FloatRect tex, sf::Color color) {
+        sf::Vector2f corners[] = {
+            rect.position,
+            {rect.position.x + rect.size.x, rect.position.y},
+            rect.position + rect.size,
+            {rect.position.x, rect.position.y + rect.size.y},
+        };
+        sf::Vector2f tex_corners[] = {
+            tex.position,
+            {tex.position.x + tex.size.x, tex.position.y},
+            tex.position + tex.size,
+            {tex.position.x, tex.position.y + tex.size.y},
+        };
+        for (unsigned i : {0, 1, 2, 0, 2, 3}) {
+            vertices.append({corners[i], color, tex_corners[i]});
         }
-        if (!isVacant()) {
-            target.draw(sprite);
+    }
+
+public:
+    void clear() {
+        vertices.clear();
+    }
+
+    void add(const Card &card) {
+        sf::FloatRect bounds = card.sprite.getGlobalBounds();
+        if (card.selected || card.hovered) {
+            //the outline lies around the card like that of a rectangle shape
+            float t = card.selected ? OUTLINE_WIDTH : OUTLINE_WIDTH / 2;
+            sf::FloatRect white = sf::FloatRect(atlasCell(NUM_CARDS, card.sprite.getTextureRect().size));
+            white = {white.position + sf::Vector2f(1, 1), {1, 1}};
+            sf::Vector2f p = bounds.position, s = bounds.size;
+            quad({{p.x - t, p.y - t}, {s.x + 2 * t, t}}, white, COLOR_SELECT);
+            quad({{p.x - t, p.y + s.y}, {s.x + 2 * t, t}}, white, COLOR_SELECT);
+            quad({{p.x - t, p.y}, {t, s.y}}, white, COLOR_SELECT);
+            quad({{p.x + s.x, p.y}, {t, s.y}}, white, COLOR_SELECT);
+        }
+        if (!card.isVacant()) {
+            quad(bounds, sf::FloatRect(card.sprite.getTextureRect()), sf::Color::White);
         }
     }
-};
 
-struct Row {
-    char idx;
+    virtual void draw(sf::RenderTarget &target, sf::RenderStates states) const override {
+        states.texture = &atlas;
+        target.draw(vertices, states);
+    }
 };
 
-struct Extra {
-    char idx;
+///the card standing in for the empty slot of a row, extra or the cellar
+constexpr char vacantCard(Place place) {
+    return NUM_CARDS + placeIndex(place);
+}
+
+std::vector<Card> cards;
+sf::Font font("assets/font/joystix_mono.otf");
+Config config;
+Statistic overall_stats;
+ReplayLog replay_log(REPLAY_FILE);
+#ifdef FRAME_STATS
+FrameStats frame_stats(FRAME_CSV);
+#endif
+
+///solves a snapshot of the board on a worker thread, so that the frame loop
+///never waits for the search; its first winning move is the hint
+class Hint : public sf::Drawable {
+    ///built by the first search, so that games without hints never allocate
+    ///the table
+    std::optional<Solver> solver;
+    std::thread worker;
+    std::atomic<bool> stop = false;
+    std::atomic<bool> done = false;
+    bool searching = false;
+    ///written by the worker before it sets done
+    Solver::Result result;
+    std::optional<Move> move;
+    std::array<char, 2> highlighted = {-1, -1};
+    sf::Text text{font, "", FONT_SIZE};
+
+    void setText(const char *str) {
+        text.setString(str);
+        text.setPosition({(WINDOW_WIDTH - text.getGlobalBounds().size.x) / 2, 0});
+    }
+
+public:
+    ~Hint() {
+        cancel();
+    }
+
+    void request(const Position &position) {
+        cancel();
+        searching = true;
+        setText("Thinking...");
+        worker = std::thread([this, position] {
+            if (!solver) {
+                solver.emplace(HINT_TABLE_BYTES, HINT_NODES);
+            }
+            result = solver->solve(position, &stop);
+            if (result == Solver::Result::Winnable) {
+                move = solver->getSolution().front();
+            }
+            done.store(true, std::memory_order_release);
+        });
+    }
+
+    ///stops the search, which notices within one node, and forgets the hint
+    void cancel() {
+        if (worker.joinable()) {
+            stop = true;
+            worker.join();
+        }
+        stop = done = searching = false;
+        move = {};
+        for (char id : highlighted) {
+            if (id >= 0) cards[id].hovered = false;
+        }
+        highlighted = {-1, -1};
+        setText("");
+    }
+
+    ///the hinted move, once the search has found one
+    std::optional<Move> poll() {
+        if (!searching || !done.load(std::memory_order_acquire)) return {};
+        worker.join();
+        searching = false;
+        if (result == Solver::Result::Unwinnable) {
+            setText("No way to win from here");
+        } else if (!move) {
+            setText("No hint found");
+        } else {
+            setText("");
+        }
+        return move;
+    }
+
+    bool isSearching() const {
+        return searching;
+    }
+
+    void highlight(char from, char to) {
+        highlighted = {from, to};
+        cards[from].hovered = cards[to].hovered = true;
+    }
+
+    virtual void draw(sf::RenderTarget &target, sf::RenderStates) const override {
+        target.draw(text);
+    }
 };
 
-struct Cellar {};
+Hint hint;
+
+///writes autosaves on a worker thread, so that the frame loop never waits
+///for the disk
+class Autosaver {
+    std::thread worker;
+    std::atomic<bool> failed = false;
+
+public:
+    ~Autosaver() {
+        wait();
+    }
+
+    ///starts writing state to filename once the previous autosave is written
+    void write(std::string filename, SaveState state) {
+        wait();
+        worker = std::thread([this, filename = std::move(filename), state = std::move(state)] {
+            if (!writeSave(filename.c_str(), state)) {
+                failed = true;
+            }
+        });
+    }
+
+    ///waits for the autosave being written, so that it can't bring back a
+    ///save removed after it
+    void wait() {
+        if (worker.joinable()) worker.join();
+    }
 
-struct Pile {
-    char idx;
+    ///whether an autosave failed since the last call
+    bool hasFailed() {
+        return failed.exchange(false);
+    }
 };
 
-using Place = std::variant<Row, Extra, Cellar, Pile>;
+Autosaver autosaver;
+
+///plays the moves of a replay one after another, Up and Down change the
+///speed and Space pauses
+class Playback : public sf::Drawable {
+    std::vector<Move> moves;
+    size_t next = 0;
+    int interval_ms = PLAYBACK_INTERVAL;
+    bool active = false;
+    bool paused = false;
+    sf::Clock clock;
+    sf::Text text{font, "", FONT_SIZE};
 
-bool same(Place a, Place b) {
-    size_t i = a.index();
-    if (b.index() != i) {
-        return false;
+    void updateText() {
+        snprintf(strbuf, sizeof(strbuf), "Replay %zu/%zu  %dms%s",
+                next, moves.size(), interval_ms, paused ? "  paused" : "");
+        text.setString(strbuf);
+        text.setPosition({WINDOW_WIDTH - text.getGlobalBounds().size.x, 0});
     }
-    switch (i) {
-    case 0:
-        return std::get<Row>(a).idx == std::get<Row>(b).idx;
-        break;
-    case 1:
-        return std::get<Extra>(a).idx == std::get<Extra>(b).idx;
-        break;
-    case 2:
-        return true;
-        break;
-    case 3:
-        return std::get<Pile>(a).idx == std::get<Pile>(b).idx;
-        break;
-    default:
-        assert(false);
-        break;
+
+public:
+    void start(const Replay &replay) {
+        moves = replay.moves;
+        next = 0;
+        active = true;
+        paused = false;
+        clock.restart();
+        updateText();
     }
-}
 
-std::array<sf::RenderTexture, NUM_CARDS + 1> card_textures;
-std::vector<Card> cards;
-sf::Font font("assets/font/joystix_mono.otf");
-Config config;
-Statistic overall_stats;
+    void stop() {
+        active = false;
+    }
 
-struct Range {
-    iterator begin;
-    iterator end;
-    Place place;
+    bool isActive() const {
+        return active;
+    }
+
+    void faster() {
+        interval_ms = std::max(interval_ms / 2, PLAYBACK_INTERVAL_MIN);
+        updateText();
+    }
+
+    void slower() {
+        interval_ms = std::min(interval_ms * 2, PLAYBACK_INTERVAL_MAX);
+        updateText();
+    }
 
-    constexpr bool isRun() const {
-        if (size() <= 1) return true;
-        for (iterator it = begin; it != end - 1; ++it) {
-            if (!cards[*it].fits(cards[it[1]])) return false;
+    void togglePause() {
+        paused = !paused;
+        clock.restart();
+        updateText();
+    }
+
+    ///time left until the next move is due
+    sf::Time untilNext() const {
+        if (!active || paused) return sf::seconds(1);
+        return std::max(sf::milliseconds(interval_ms) - clock.getElapsedTime(), sf::milliseconds(1));
+    }
+
+    ///the next move once it is due, the playback ends after the last one
+    std::optional<Move> poll() {
+        if (!active || paused || clock.getElapsedTime() < sf::milliseconds(interval_ms)) return {};
+        clock.restart();
+        if (next == moves.size()) {
+            active = false;
+            return {};
         }
-        return true;
+        Move move = moves[next++];
+        updateText();
+        return move;
     }
 
+    virtual void draw(sf::RenderTarget &target, sf::RenderStates) const override {
+        if (active) target.draw(text);
+    }
+};
+
+Playback playback;
+
+///cards [begin, end) of a place, counted from the bottom;
+///an empty range stands for the vacant slot
+struct Range {
+    Place place;
+    unsigned begin;
+    unsigned end;
+
     constexpr bool isLeftToRight() const {
         return (std::holds_alternative<Row>(place) && std::get<Row>(place).idx >= 4)
             || (std::holds_alternative<Extra>(place) && std::get<Extra>(place).idx == 1);
@@ -175,18 +386,13 @@ struct Duration {
 };
 
 class Game : public sf::Drawable {
-    struct Move {
-        Place from;
-        unsigned size;
-        Place to;
-        bool reversed;
-    };
-
     class Stats {
         friend Game;
 
         sf::Text text_left{font, "", FONT_SIZE};
         sf::Text text_right{font, "", FONT_SIZE};
+        sf::Text text_moves{font, "", FONT_SIZE};
+        sf::Text text_times{font, "", FONT_SIZE};
         sf::Text reshuffle_info{font, "Press Ctrl+S to shuffle cards", FONT_SIZE};
         unsigned consecutive_undos = 0;
         bool won = false;
@@ -200,6 +406,13 @@ class Game : public sf::Drawable {
             return config.real_moves ? real_moves : moves;
         }
 
+        ///time left until the timer shows the next second
+        sf::Time untilNextTick() const {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            long long nsecs = NSEC_PER_SEC - elapsed.count() % NSEC_PER_SEC;
+            return sf::microseconds(std::max(nsecs / 1000, 1000LL));
+        }
+
         Duration timeElapsed() const {
             chrono_time_point end = std::chrono::steady_clock::now();
             auto duration = end - start;
@@ -212,7 +425,7 @@ class Game : public sf::Drawable {
 
         void registerMove(Move move) {
             ++moves;
-            real_moves += move.size > 1 && !move.reversed ? 2 * move.size : move.size;
+            real_moves += realMoves(move);
             consecutive_undos = 0;
         }
 
@@ -221,16 +434,51 @@ class Game : public sf::Drawable {
             if (++consecutive_undos > config.num_cons_undos_allow) {
                 used_undo = true;
             }
-            real_moves -= move.size > 1 && !move.reversed ? 2 * move.size : move.size;
+            real_moves -= realMoves(move);
         }
 
-        ///call only once
+        ///undoes registerUndo, except that used_undo stays set: only the
+        ///moves still taken back count as consecutive undos
+        void registerRedo(Move move) {
+            ++moves;
+            if (consecutive_undos > 0) {
+                --consecutive_undos;
+            }
+            real_moves += realMoves(move);
+        }
+
+        uint32_t elapsedMs() const {
+            auto duration = std::chrono::steady_clock::now() - start;
+            return duration.count() / (NSEC_PER_SEC / 1000);
+        }
+
+        ///takes over the counters of a saved game, whose timer runs on from
+        ///where it stopped
+        void resume(const SaveHeader &header) {
+            moves = header.moves;
+            real_moves = header.real_moves;
+            consecutive_undos = header.consecutive_undos;
+            used_undo = header.used_undo;
+            start = std::chrono::steady_clock::now() - std::chrono::milliseconds(header.elapsed_ms);
+        }
+
+        GameRecord record(uint64_t deal, bool won) const {
+            return {
+                deal,
+                (uint32_t)std::time(nullptr),
+                elapsedMs(),
+                moves,
+                real_moves,
+                config,
+                won,
+                used_undo,
+            };
+        }
+
+        ///call only once, after the win is counted
         void registerWin() {
             assert(!won);
             won = true;
-            if (!used_undo || config.consider_undo_wins) {
-                overall_stats.recordWin(getMoves());
-            }
             Duration dur = timeElapsed();
             snprintf(strbuf, sizeof(strbuf), "Time  %u:%u\n"
                                              "Moves %u\n"
@@ -251,366 +499,704 @@ class Game : public sf::Drawable {
             text_right = sf::Text(font, strbuf, FONT_SIZE);
             text_size = text_right.getGlobalBounds().size;
             text_right.setPosition({WINDOW_WIDTH * 0.75f - text_size.x / 2, (WINDOW_HEIGHT / 2.f - text_size.y) / 2});
+            std::string moves_table = "Moves     p50  p90\n";
+            std::string times_table = "Time      p50   p90\n";
+            addSpread(moves_table, times_table, "All", overall_stats.spread_all);
+            snprintf(strbuf, sizeof(strbuf), "Last %u", RECENT_GAMES);
+            addSpread(moves_table, times_table, strbuf, overall_stats.spread_games);
+            snprintf(strbuf, sizeof(strbuf), "%u days", RECENT_DAYS);
+            addSpread(moves_table, times_table, strbuf, overall_stats.spread_days);
+            text_moves = sf::Text(font, moves_table, FONT_SIZE);
+            text_size = text_moves.getGlobalBounds().size;
+            text_moves.setPosition({(WINDOW_WIDTH / 2.f - text_size.x) / 2, WINDOW_HEIGHT * 0.75f - text_size.y / 2});
+            text_times = sf::Text(font, times_table, FONT_SIZE);
+            text_size = text_times.getGlobalBounds().size;
+            text_times.setPosition({WINDOW_WIDTH * 0.75f - text_size.x / 2, WINDOW_HEIGHT * 0.75f - text_size.y / 2});
+        }
+
+        ///a line of the median and 90th percentile of the moves and of the
+        ///times of spread to each table
+        static void addSpread(std::string &moves_table, std::string &times_table, const char *name, const Distribution &spread) {
+            const Sketch &moves = config.real_moves ? spread.real_moves : spread.moves;
+            char line[64];
+            if (moves.getCount() == 0) {
+                snprintf(line, sizeof(line), "%-9s %-4s %s\n", name, "-", "-");
+                moves_table += line;
+                snprintf(line, sizeof(line), "%-9s %-5s %s\n", name, "-", "-");
+                times_table += line;
+                return;
+            }
+            snprintf(line, sizeof(line), "%-9s %-4u %u\n", name, moves.quantile(0.5), moves.quantile(0.9));
+            moves_table += line;
+            char median[16], slow[16];
+            unsigned secs = spread.duration_ms.quantile(0.5) / 1000;
+            snprintf(median, sizeof(median), "%u:%02u", secs / 60, secs % 60);
+            secs = spread.duration_ms.quantile(0.9) / 1000;
+            snprintf(slow, sizeof(slow), "%u:%02u", secs / 60, secs % 60);
+            snprintf(line, sizeof(line), "%-9s %-5s %s\n", name, median, slow);
+            times_table += line;
         }
     };
 
-    std::vector<Move> history;
-    std::array<std::vector<char>, 4> piles;
-    std::array<std::vector<char>, 8> rows;
-    std::array<std::vector<char>, 2> extra;
-    std::vector<char> cellar;
+    Board board;
+    std::array<sf::Vector2f, NUM_PLACES> origins;
+    ///the cards lying still, redrawn only when a card moved or its outline
+    ///or whether it is held changed since
+    mutable sf::RenderTexture layer;
+    mutable CardBatch batch;
+    mutable bool dirty = true;
+    mutable std::array<unsigned char, NUM_CARDS + NUM_VACANT> drawn_outlines;
+    mutable std::optional<Range> drawn_held;
+    ///the places in each band of the layout: the piles with rows 0 to 3 and
+    ///their neighbours, then the extras and the cellar
+    std::array<std::vector<Place>, NUM_PILES + 1> bands;
+    ///how many cards of each place lie where layout put them, the ones above
+    ///are being dragged
+    std::array<unsigned, NUM_PLACES> resting = {};
+
+    ///horizontal distance between neighbouring cards of a place
+    static float spacing(Place place) {
+        return std::holds_alternative<Row>(place) ? CARD_WR : CARD_WS + CARD_MARGIN;
+    }
+
+    static sf::Vector2f cardSize() {
+        return cards[0].sprite.getGlobalBounds().size;
+    }
+
+    ///the resting cards lo to hi of place that may contain x, worked out from
+    ///the layout instead of looking at every card; one more on either side,
+    ///since the positions were summed up in floating point
+    std::pair<int, int> hits(Place place, float x) const {
+        float o = origins[placeIndex(place)].x;
+        float dx = spacing(place);
+        float w = cardSize().x;
+        int lo, hi;
+        if (Range(place, 0, 0).isLeftToRight()) {
+            lo = std::floor((x - w - o) / dx) + 1;
+            hi = std::floor((x - o) / dx);
+        } else {
+            lo = std::ceil((o - x) / dx);
+            hi = std::ceil((o + w - x) / dx) - 1;
+        }
+        unsigned n = std::min<unsigned>(resting[placeIndex(place)], board.size(place));
+        return {std::max(lo - 1, 0), std::min(hi + 1, (int)n - 1)};
+    }
+
+    bool isHeld(Place place, unsigned i) const {
+        return held && same(held->place, place) && i >= held->begin && i < held->end;
+    }
+
+    void addPlace(Place place) const {
+        std::span<const char> row = board.getPlace(place);
+        for (unsigned i = 0; i < row.size(); ++i) {
+            if (!isHeld(place, i)) batch.add(cards[row[i]]);
+        }
+    }
+
+    ///whether the layer is out of date, remembering what it will show
+    bool refresh() const {
+        std::array<unsigned char, NUM_CARDS + NUM_VACANT> outlines;
+        for (unsigned i = 0; i < outlines.size(); ++i) {
+            outlines[i] = cards[i].selected | cards[i].hovered << 1;
+        }
+        bool same_held = held.has_value() == drawn_held.has_value()
+            && (!held || (same(held->place, drawn_held->place)
+                        && held->begin == drawn_held->begin && held->end == drawn_held->end));
+        if (!dirty && same_held && outlines == drawn_outlines) return false;
+        dirty = false;
+        drawn_outlines = outlines;
+        drawn_held = held;
+        return true;
+    }
 
 public:
     Stats stats;
+    ///false for a replay being played back, which is neither counted nor kept
+    bool counted = true;
+    ///counts up with every save, the newest one is resumed
+    uint64_t save_sequence = 0;
+    ///whether a move or undo of a counted game is in no save yet
+    bool unsaved = false;
+    unsigned autosave_slot = 0;
+    chrono_time_point autosaved = chrono_clock::now();
+    ///cards being dragged, which are left out of the layer and drawn on top
+    std::optional<Range> held;
+
+    ///whole place as a range
+    Range getRange(Place place) const {
+        return {place, 0, (unsigned)board.getPlace(place).size()};
+    }
+
+    ///id of the first card of range in the given order, or of the vacant slot
+    char front(const Range &range, bool reversed = false) const {
+        if (range.size() == 0) return vacantCard(range.place);
+        std::span<const char> row = board.getPlace(range.place);
+        return reversed ? row[range.end - 1] : row[range.begin];
+    }
 
-    static void setPilePositions(Range range, sf::Vector2f pos)
-    {
-        bool stacked = std::holds_alternative<Row>(range.place);
+    char back(const Range &range, bool reversed = false) const {
+        return front(range, !reversed);
+    }
+
+    void setPilePositions(const Range &range, sf::Vector2f pos, bool reversed = false) {
+        TIME_PHASE(PHASE_LAYOUT);
+        unsigned i = placeIndex(range.place);
+        resting[i] = std::min(resting[i], range.begin);
         bool left_to_right = range.isLeftToRight();
+        std::span<const char> row = board.getPlace(range.place);
         if (std::holds_alternative<Pile>(range.place)) {
-            cards[*(range.end - 1)].sprite.setPosition(pos);
+            cards[row.back()].sprite.setPosition(pos);
         } else {
-            for (iterator it = range.begin; it != range.end; ++it) {
-                Card &card = cards[*it];
+            for (unsigned i = 0; i < range.size(); ++i) {
+                Card &card = cards[row[reversed ? range.end - 1 - i : range.begin + i]];
                 card.sprite.setPosition(pos);
-                if (card.isVacant()) continue;
-                float dx = stacked ? CARD_WR : CARD_WS + CARD_MARGIN;
-                pos.x += left_to_right ? dx : -dx;
+                pos.x += left_to_right ? spacing(range.place) : -spacing(range.place);
             }
         }
     }
 
-    static void initPile(
-            std::vector<char> &vec,
-            std::list<char> &shuffled,
-            unsigned n,
-            char *next_vacant)
-    {
-        assert(vec.size() == 0);
-        vec.reserve(n + 1);
-        if (next_vacant) {
-            vec.push_back((*next_vacant)++);
-        }
-        for (unsigned i = 0; i < n; ++i) {
-            char c = shuffled.back();
-            shuffled.pop_back();
-            vec.push_back(c);
-        }
+    ///puts the cards of place to rest; setPilePositions alone only moves
+    ///held cards, which the layer leaves out, so only this redraws it
+    void layout(Place place) {
+        dirty = true;
+        setPilePositions(getRange(place), origins[placeIndex(place)]);
+        resting[placeIndex(place)] = board.size(place);
     }
 
-    Game() {
-        char next_vacant = NUM_CARDS;
-        std::array<char, NUM_CARDS> tmp;
-        for (unsigned i = 0; i < NUM_CARDS; ++i) {
-            tmp[i] = i;
-        }
+    static uint64_t randomDeal() {
         static std::random_device rd;
-        static std::mt19937 g(rd());
-        //static std::mt19937 g(0);
-        std::shuffle(tmp.begin(), tmp.end(), g);
-        std::list<char> shuffled;
-        for (unsigned i = 0; i < NUM_CARDS; ++i) {
-            shuffled.push_back(tmp[i]);
-        }
+        return (uint64_t)rd() << 32 | rd();
+    }
+
+    explicit Game(uint64_t number = randomDeal()) {
+        board.deal(number);
         sf::Vector2f pos = {
             (WINDOW_WIDTH - CARD_WS) / 2,
             START_Y,
         };
-        char c = shuffled.back() % CARDS_PER_SUIT;
-        for (unsigned i = 0; i < 4; ++i) {
-            shuffled.remove(c);
-            cards[c].sprite.setPosition(pos);
-            piles[i].reserve(CARDS_PER_SUIT);
-            piles[i].push_back(c);
-            c += CARDS_PER_SUIT;
+        for (char i = 0; i < NUM_PILES; ++i) {
+            origins[placeIndex(Pile(i))] = pos;
             pos.y += CARD_HS + ROW_MARGIN;
         }
         pos.y = START_Y;
         pos.x -= CARD_MARGIN + CARD_WS;
-        for (unsigned i = 0; i < 4; ++i) {
-            initPile(rows[i], shuffled, 5, &next_vacant);
-            setPilePositions({rows[i].begin(), rows[i].end(), Row(i)}, pos);
+        for (char i = 0; i < 4; ++i) {
+            origins[placeIndex(Row(i))] = pos;
             pos.y += CARD_HS + ROW_MARGIN;
         }
-        initPile(extra[0], shuffled, 4, &next_vacant);
-        setPilePositions({extra[0].begin(), extra[0].end(), Extra(0)}, pos);
+        origins[placeIndex(Extra(0))] = pos;
         pos.y = START_Y;
         pos.x += (CARD_WS + CARD_MARGIN) * 2;
-        for (unsigned i = 4; i < 8; ++i) {
-            initPile(rows[i], shuffled, 5, &next_vacant);
-            setPilePositions({rows[i].begin(), rows[i].end(), Row(i)}, pos);
+        for (char i = 4; i < 8; ++i) {
+            origins[placeIndex(Row(i))] = pos;
             pos.y += CARD_HS + ROW_MARGIN;
         }
-        initPile(extra[1], shuffled, 4, &next_vacant);
-        setPilePositions({extra[1].begin(), extra[1].end(), Extra(1)}, pos);
+        origins[placeIndex(Extra(1))] = pos;
         pos.x -= CARD_MARGIN + CARD_WS;
-        cards[next_vacant].sprite.setPosition(pos);
-        cellar.reserve(2);
-        cellar.push_back(next_vacant);
+        origins[placeIndex(Cellar())] = pos;
+        for (unsigned i = 0; i < NUM_VACANT; ++i) {
+            cards[NUM_CARDS + i].sprite.setPosition(origins[i]);
+        }
+        auto addToBand = [&](Place place) {
+            float band = (origins[placeIndex(place)].y - START_Y) / (CARD_HS + ROW_MARGIN);
+            bands[std::lround(band)].push_back(place);
+        };
+        for (char i = 0; i < NUM_ROWS; ++i) addToBand(Row(i));
+        for (char i = 0; i < NUM_EXTRA; ++i) addToBand(Extra(i));
+        addToBand(Cellar());
+        for (char i = 0; i < NUM_PILES; ++i) addToBand(Pile(i));
+        layoutAll();
+    }
+
+    ///continues a saved game
+    explicit Game(const SaveState &state) : Game(state.header.deal) {
+        board.resume(state.header.deal, state.header.position, state.history);
+        stats.resume(state.header);
+        save_sequence = state.header.sequence;
+        layoutAll();
+    }
+
+    void layoutAll() {
+        for (char i = 0; i < NUM_ROWS; ++i) layout(Row(i));
+        for (char i = 0; i < NUM_EXTRA; ++i) layout(Extra(i));
+        layout(Cellar());
+        for (char i = 0; i < NUM_PILES; ++i) layout(Pile(i));
+    }
+
+    ///the game as it is now, under the next save sequence number
+    SaveState saveState() {
+        SaveState state;
+        state.header = {};
+        state.header.sequence = ++save_sequence;
+        state.header.deal = board.getDealNumber();
+        state.header.position = board;
+        state.header.elapsed_ms = stats.elapsedMs();
+        state.header.moves = stats.moves;
+        state.header.real_moves = stats.real_moves;
+        state.header.consecutive_undos = stats.consecutive_undos;
+        state.header.used_undo = stats.used_undo;
+        state.history = board.getHistory();
+        return state;
+    }
+
+    bool save(const char *filename) {
+        //a failed save is tried again by the next autosave or at close
+        if (!writeSave(filename, saveState())) return false;
+        unsaved = false;
+        return true;
+    }
+
+    ///starts saving into the next autosave slot if the game changed and the
+    ///last autosave is AUTOSAVE_SECS old
+    void autosave() {
+        //a failed autosave is tried again by the next one
+        if (autosaver.hasFailed()) {
+            unsaved = true;
+        }
+        chrono_time_point now = chrono_clock::now();
+        if (!unsaved || now - autosaved < std::chrono::seconds(AUTOSAVE_SECS)) return;
+        autosaved = now;
+        autosaver.write(autosaveFile(autosave_slot), saveState());
+        unsaved = false;
+        autosave_slot = (autosave_slot + 1) % AUTOSAVE_SLOTS;
     }
 
     constexpr bool won() const {
         return stats.won;
     }
 
-    char numVacantRows() const {
-        char count = 0;
-        for (const auto &row : rows) {
-            if (row.size() == 1) ++count;
+    std::span<const char> getPlace(Place place) const {
+        return board.getPlace(place);
+    }
+
+    ///counts the game and keeps its replay, unless it is being played back
+    void finish(bool won) {
+        if (!counted) return;
+        unsaved = false;
+        autosaver.wait();
+        removeSaves();
+        GameRecord record = stats.record(board.getDealNumber(), won);
+        overall_stats.record(record);
+        if (!replay_log.append({record.deal, record.finished, won, board.getHistory()})) {
+            fprintf(stderr, "failed to write %s\n", REPLAY_FILE);
         }
-        return count;
+    }
+
+    ///counts the game as lost
+    void registerLoss() {
+        finish(false);
+    }
+
+    const Board &getBoard() const {
+        return board;
+    }
+
+    char numVacantRows() const {
+        return board.numVacantRows();
     }
 
     char numVacantExtra() const {
-        char count = 0;
-        for (const auto &row : extra) {
-            if (row.size() == 1) ++count;
-        }
-        return count;
+        return board.numVacantExtra();
     }
 
     std::optional<Range> select(sf::Vector2i mouse_pos) {
+        TIME_PHASE(PHASE_SELECT);
         sf::Vector2f pos = {(float)mouse_pos.x, (float)mouse_pos.y};
-        for (unsigned i = 8; i-- > 0;) {
-            std::vector<char> &row = rows[i];
-            for (iterator it = row.end(); it-- != row.begin();) {
-                Card &card = cards[*it];
-                if (card.selected) continue;
-                if (card.sprite.getGlobalBounds().contains(pos)) {
-                    Range range(it, row.end(), Row(i));
-                    if (range.size() == 1 || (numVacantRows() && range.isRun())) {
-                        return range;
-                    }
-                    return {};
+        int band = std::floor((pos.y - START_Y) / (CARD_HS + ROW_MARGIN));
+        if (band < 0 || band >= (int)bands.size()) return {};
+        for (Place place : bands[band]) {
+            sf::FloatRect slot(origins[placeIndex(place)], cardSize());
+            if (!slot.contains({slot.position.x, pos.y})) continue;
+            std::span<const char> row = board.getPlace(place);
+            if (std::holds_alternative<Pile>(place)) {
+                if (slot.contains(pos)) {
+                    return Range(place, row.size() - 1, row.size());
                 }
+                continue;
             }
-        }
-        for (unsigned i = 2; i-- > 0;) {
-            std::vector<char> &row = extra[i];
-            for (iterator it = row.end(); it-- != row.begin();) {
-                Card &card = cards[*it];
-                if (card.selected || card.isVacant()) continue;
-                if (card.sprite.getGlobalBounds().contains(pos)) {
-                    return it == row.end() - 1 ? Range(it, row.end(), Extra(i)) : std::optional<Range>();
+            auto [lo, hi] = hits(place, pos.x);
+            for (int j = hi; j >= lo; --j) {
+                Card &card = cards[row[j]];
+                if (card.selected || !card.sprite.getGlobalBounds().contains(pos)) continue;
+                Range range(place, j, row.size());
+                if (range.size() == 1 || (std::holds_alternative<Row>(place)
+                            && numVacantRows() && board.isRun(place, range.size())))
+                {
+                    return range;
                 }
+                return {};
             }
-        }
-        for (iterator it = cellar.end(); it-- != cellar.begin();) {
-            Card &card = cards[*it];
-            if (card.selected) continue;
-            if (card.sprite.getGlobalBounds().contains(pos)) {
-                assert(cellar.size() <= 2);
-                return Range(it, cellar.end(), Cellar());
-            }
-        }
-        for (unsigned i = 0; i < 4; ++i) {
-            Card &card = cards[piles[i].back()];
-            if (card.sprite.getGlobalBounds().contains(pos)) {
-                return Range(piles[i].end() - 1, piles[i].end(), Pile(i));
+            if (!std::holds_alternative<Extra>(place) && slot.contains(pos)) {
+                return row.empty() ? Range(place, 0, 0) : std::optional<Range>();
             }
         }
         return {};
     }
 
-    constexpr std::vector<char> &getPlace(Place place) {
-        if (std::holds_alternative<Row>(place)) {
-            return rows[std::get<Row>(place).idx];
-        } else if (std::holds_alternative<Extra>(place)) {
-            return extra[std::get<Extra>(place).idx];
-        } else if (std::holds_alternative<Pile>(place)) {
-            return piles[std::get<Pile>(place).idx];
-        } else {
-            return cellar;
+    bool tryMove(const Range &from, const Range &to, bool reversed) {
+        Card &last = cards[back(to)];
+        Card &first = cards[front(from, reversed)];
+        first.selected = first.hovered = false;
+        Move move(from.place, from.size(), to.place, reversed);
+        if (!play(move)) {
+            layout(from.place);
+            return false;
         }
+        last.selected = last.hovered = false;
+        Card &tmp = cards[front(to)];
+        tmp.selected = tmp.hovered = false;
+        return true;
     }
 
-    bool tryMove(const Range &from, const Range &to, bool reversed) {
-        bool result = false;
-        Card &last = cards[*(to.end - 1)];
-        Card &first = cards[*from.begin];
-        std::vector<char> &row_from = getPlace(from.place);
-        std::vector<char> &row_to = getPlace(to.place);
-        unsigned size_from = from.size();
-        first.selected = first.hovered = false;
-        if ((std::holds_alternative<Cellar>(to.place) 
-                && last.isVacant()
-                && size_from == 1
-                && !std::holds_alternative<Extra>(from.place))
-            || ((std::holds_alternative<Row>(to.place) || std::holds_alternative<Pile>(to.place))
-                && last.fits(first))
-            || (std::holds_alternative<Row>(to.place)
-                && last.isVacant()
-                && (size_from == 1 || numVacantRows() >= 2 || reversed)))
-        {
-            Move move(from.place, size_from, to.place, reversed);
-            history.push_back(move);
-            stats.registerMove(move);
-            result = true;
-            last.selected = last.hovered = false;
-            Card &tmp = cards[*to.begin];
-            tmp.selected = tmp.hovered = false;
-            for (iterator it = from.begin; it != from.end; ++it) {
-                row_to.push_back(*it);
-            }
-            for (unsigned i = 0; i < size_from; ++i) {
-                row_from.pop_back();
-            }
+    ///applies move if it is legal, wherever it came from
+    bool play(const Move &move) {
+        TIME_PHASE(PHASE_MOVE);
+        if (!board.tryMove(move)) return false;
+        hint.cancel();
+        stats.registerMove(move);
+        unsaved = counted;
+        layout(move.from);
+        layout(move.to);
+        if (board.won()) {
+            finish(true);
+            stats.registerWin();
         }
-        if (result) {
-            Game::setPilePositions(
-                    {row_to.begin(), row_to.end(), to.place},
-                    cards[*row_to.begin()].sprite.getPosition());
+        return true;
+    }
 
-            if (numVacantRows() == 8 
-                    && numVacantExtra() == 2 
-                    && cellar.size() == 1)
-            {
-                stats.registerWin();
-            }
-        } else {
-            Game::setPilePositions(
-                    {row_from.begin(), row_from.end(), from.place},
-                    cards[*row_from.begin()].sprite.getPosition());
-        }
-        return result;
-    }
-
-    ///don't call while dragging
-    bool undo() {
-        if (history.size() == 0) return false;
-        //inefficient, but I don't care anymore
-        for (Card &card : cards) {
-            card.hovered = card.selected = false;
-        }
-        Move move = history.back();
-        history.pop_back();
-        stats.registerUndo(move);
-        std::vector<char> &row_from = getPlace(move.from);
-        std::vector<char> &row_to = getPlace(move.to);
-        if (move.reversed) {
-            for (iterator it = row_to.end(); it-- != row_to.end() - move.size;) {
-                row_from.push_back(*it);
-            }
-        } else {
-            for (iterator it = row_to.end() - move.size; it != row_to.end(); ++it) {
-                row_from.push_back(*it);
-            }
+    ///moves made so far, and the most that can be made again by redo
+    size_t numMoves() const {
+        return board.getHistory().size();
+    }
+
+    size_t numMovesRedoable() const {
+        return numMoves() + board.numUndone();
+    }
+
+    ///takes back or makes again moves until n are made, then lays out only
+    ///the places whose cards changed; don't call while dragging
+    bool seek(size_t n) {
+        if (n == numMoves() || n > numMovesRedoable()) return false;
+        hint.cancel();
+        Position before = board;
+        while (numMoves() > n) {
+            stats.registerUndo(*board.undo());
         }
-        for (unsigned i = 0; i < move.size; ++i) {
-            row_to.pop_back();
+        while (numMoves() < n) {
+            stats.registerRedo(*board.redo());
         }
-        setPilePositions(
-                {row_from.begin(), row_from.end(), move.from},
-                cards[row_from.front()].sprite.getPosition());
+        unsaved = counted;
+        auto update = [&](Place place) {
+            std::span<const char> now = board.getPlace(place);
+            if (std::ranges::equal(before.getPlace(place), now)) return;
+            for (char id : now) {
+                cards[id].hovered = cards[id].selected = false;
+            }
+            Card &vacant = cards[vacantCard(place)];
+            vacant.hovered = vacant.selected = false;
+            layout(place);
+        };
+        for (char i = 0; i < NUM_ROWS; ++i) update(Row(i));
+        for (char i = 0; i < NUM_EXTRA; ++i) update(Extra(i));
+        update(Cellar());
+        for (char i = 0; i < NUM_PILES; ++i) update(Pile(i));
         return true;
     }
 
     virtual void draw(sf::RenderTarget &target, sf::RenderStates) const override {
-        for (auto &row : rows) {
-            for (char c : row) {
-                target.draw(cards[c]);
+        if (refresh()) {
+            if (layer.getSize() != sf::Vector2u(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+                layer = sf::RenderTexture({WINDOW_WIDTH, WINDOW_HEIGHT});
             }
-        }
-        for (auto &row : extra) {
-            for (char c : row) {
-                target.draw(cards[c]);
+            batch.clear();
+            for (char i = 0; i < NUM_ROWS; ++i) {
+                batch.add(cards[vacantCard(Row(i))]);
+                addPlace(Row(i));
             }
+            for (char i = 0; i < NUM_EXTRA; ++i) {
+                batch.add(cards[vacantCard(Extra(i))]);
+                addPlace(Extra(i));
+            }
+            batch.add(cards[vacantCard(Cellar())]);
+            addPlace(Cellar());
+            for (char i = 0; i < NUM_PILES; ++i) {
+                batch.add(cards[board.getPlace(Pile(i)).back()]);
+            }
+            layer.clear(COLOR_BG);
+            layer.draw(batch);
+            layer.display();
         }
-        for (char c : cellar) {
-            target.draw(cards[c]);
-        }
-        target.draw(cards[piles[0].back()]);
-        target.draw(cards[piles[1].back()]);
-        target.draw(cards[piles[2].back()]);
-        target.draw(cards[piles[3].back()]);
+        target.draw(sf::Sprite(layer.getTexture()));
         if (won()) {
             target.draw(stats.text_left);
             target.draw(stats.text_right);
+            target.draw(stats.text_moves);
+            target.draw(stats.text_times);
             target.draw(stats.reshuffle_info);
         } else {
             Duration dur = stats.timeElapsed();
-            snprintf(strbuf, sizeof(strbuf), "%u:%u", dur.mins, dur.secs);
+            snprintf(strbuf, sizeof(strbuf), "%u:%u  #%llu",
+                    dur.mins, dur.secs, (unsigned long long)board.getDealNumber());
             sf::Text text(font, strbuf, FONT_SIZE);
             target.draw(text);
         }
     }
 };
 
-void loadCards() {
-    cards.reserve(NUM_CARDS + NUM_VACANT);
-    sf::Vector2u texture_size = {(unsigned)CARD_WS + 2 * OUTLINE_WIDTH, (unsigned)CARD_HS + 2 * OUTLINE_WIDTH};
+///the number of moves key goes to: Backspace or Left takes one back, Right
+///makes it again, Page Up and Page Down go 10 moves, Home and End to the
+///first and the last
+std::optional<size_t> seekTarget(const sf::Event::KeyPressed &key, const Game &game) {
+    using enum sf::Keyboard::Key;
+    size_t n = game.numMoves();
+    size_t last = game.numMovesRedoable();
+    size_t target;
+    switch (key.code) {
+    case Backspace:
+    case Left:
+        target = n > 0 ? n - 1 : n;
+        break;
+    case Right:
+        target = std::min(n + 1, last);
+        break;
+    case PageUp:
+        target = n - std::min<size_t>(n, 10);
+        break;
+    case PageDown:
+        target = std::min<size_t>(n + 10, last);
+        break;
+    case Home:
+        target = 0;
+        break;
+    case End:
+        target = last;
+        break;
+    default:
+        return {};
+    }
+    if (target == n || (target < n && !config.enable_undo)) return {};
+    return target;
+}
+
+std::string cardFile(unsigned i) {
+    char numeric[2] = {};
     const char *suit_str, *rank_str;
-    for (unsigned i = 0; i < NUM_CARDS; ++i) {
-        char numeric[2] = {};
-        Suit suit = (Suit)(i / CARDS_PER_SUIT);
-        unsigned rank = i % CARDS_PER_SUIT;
-        switch (rank) {
-        case Jack:
-            rank_str = "jack";
-            break;
-        case Queen:
-            rank_str = "queen";
-            break;
-        case King:
-            rank_str = "king";
+    Suit suit = (Suit)CARD_INFO[i].suit;
+    unsigned rank = CARD_INFO[i].rank;
+    switch (rank) {
+    case Jack:
+        rank_str = "jack";
+        break;
+    case Queen:
+        rank_str = "queen";
+        break;
+    case King:
+        rank_str = "king";
+        break;
+    case Ace:
+        rank_str = "ace";
+        break;
+    case 10:
+        rank_str = "10";
+        break;
+    default:
+        numeric[0] = '0' + rank;
+        rank_str = numeric;
+        break;
+    }
+    switch (suit) {
+        case Clubs:
+            suit_str = "clubs";
             break;
-        case Ace:
-            rank_str = "ace";
+        case Hearts:
+            suit_str = "hearts";
             break;
-        case 10:
-            rank_str = "10";
+        case Spades:
+            suit_str = "spades";
             break;
-        default:
-            numeric[0] = '0' + rank;
-            rank_str = numeric;
+        case Diamonds:
+            suit_str = "diamonds";
             break;
+    }
+    return std::string("assets/") + rank_str + "_of_" + suit_str + ".png";
+}
+
+///decodes the card faces into the cells of one image on all cores, while
+///the main thread goes on opening the window
+class CardDecoder {
+    sf::Image sheet{{CARD_WIDTH * ATLAS_COLUMNS, CARD_HEIGHT * ATLAS_ROWS}};
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next = 0;
+    std::atomic<bool> failed = false;
+
+    void join() {
+        for (std::thread &worker : workers) {
+            worker.join();
         }
-        switch (suit) {
-            case Clubs:
-                suit_str = "clubs";
-                break;
-            case Hearts:
-                suit_str = "hearts";
-                break;
-            case Spades:
-                suit_str = "spades";
-                break;
-            case Diamonds:
-                suit_str = "diamonds";
-                break;
+        workers.clear();
+    }
+
+public:
+    CardDecoder() {
+        unsigned n = std::clamp(std::thread::hardware_concurrency(), 1u, (unsigned)NUM_CARDS);
+        for (unsigned t = 0; t < n; ++t) {
+            workers.emplace_back([this] {
+                //every face lands in a cell of its own, so the copies don't overlap
+                for (unsigned i; (i = next++) < NUM_CARDS;) {
+                    sf::Image face;
+                    sf::Vector2u cell = sf::Vector2u(atlasCell(i, {CARD_WIDTH, CARD_HEIGHT}).position);
+                    if (!face.loadFromFile(cardFile(i)) || !sheet.copy(face, cell)) {
+                        failed = true;
+                    }
+                }
+            });
         }
-        std::sprintf(strbuf, "assets/%s_of_%s.png", rank_str, suit_str);
-        sf::RenderTexture texture(texture_size);
-        texture.clear(COLOR_CARD);
+    }
+
+    ~CardDecoder() {
+        join();
+    }
+
+    ///waits for the workers, the sheet is complete afterwards
+    const sf::Image &finish() {
+        join();
+        if (failed) {
+            throw std::runtime_error("failed to load the card images");
+        }
+        return sheet;
+    }
+};
+
+///what the pack depends on: how cards are drawn and every face image
+uint64_t packStamp() {
+    uint64_t stamp = 0xcbf29ce484222325;
+    auto add = [&](uint64_t value) {
+        stamp = (stamp ^ value) * 0x100000001b3;
+    };
+    for (uint64_t value : {CARD_WIDTH, CARD_HEIGHT, (int)(CARD_SCALE * 1000), OUTLINE_WIDTH, ATLAS_COLUMNS}) {
+        add(value);
+    }
+    for (sf::Color color : {COLOR_CARD, COLOR_OUTLINE}) {
+        add(color.r << 24 | color.g << 16 | color.b << 8 | color.a);
+    }
+    for (unsigned i = 0; i < NUM_CARDS; ++i) {
+        std::error_code ec;
+        std::string file = cardFile(i);
+        add(std::filesystem::file_size(file, ec));
+        add(std::filesystem::last_write_time(file, ec).time_since_epoch().count());
+    }
+    return stamp;
+}
+
+sf::Vector2i cellSize() {
+    return {(int)CARD_WS + 2 * OUTLINE_WIDTH, (int)CARD_HS + 2 * OUTLINE_WIDTH};
+}
+
+///uploads the decoded faces at once and renders them with their outlines
+///into the atlas
+void renderAtlas(const sf::Image &sheet) {
+    sf::Vector2i cell_size = cellSize();
+    sf::RenderTexture target({(unsigned)cell_size.x * ATLAS_COLUMNS, (unsigned)cell_size.y * ATLAS_ROWS});
+    target.clear(COLOR_CARD);
+    sf::Texture faces(sheet);
+    for (unsigned i = 0; i < NUM_CARDS; ++i) {
+        sf::Vector2f cell_pos = sf::Vector2f(atlasCell(i, cell_size).position);
         sf::RectangleShape rect({CARD_WS, CARD_HS});
-        rect.setPosition({OUTLINE_WIDTH, OUTLINE_WIDTH});
+        rect.setPosition(cell_pos + sf::Vector2f(OUTLINE_WIDTH, OUTLINE_WIDTH));
         rect.setOutlineColor(COLOR_OUTLINE);
         rect.setOutlineThickness(OUTLINE_WIDTH);
-        texture.draw(rect);
-        sf::Texture tmp(strbuf);
-        sf::Sprite sprite(tmp);
-        sprite.setPosition({OUTLINE_WIDTH, OUTLINE_WIDTH});
+        target.draw(rect);
+        sf::Sprite sprite(faces, atlasCell(i, {CARD_WIDTH, CARD_HEIGHT}));
+        sprite.setPosition(cell_pos + sf::Vector2f(OUTLINE_WIDTH, OUTLINE_WIDTH));
         sprite.scale({CARD_SCALE, CARD_SCALE});
-        texture.draw(sprite);
-        texture.display();
-        card_textures[i] = std::move(texture);
-        cards.emplace_back(card_textures[i].getTexture(), i);
-    }
-    sf::RenderTexture texture(texture_size);
-    texture.clear(sf::Color::Transparent);
-    texture.display();
-    card_textures[NUM_CARDS] = std::move(texture);
+        target.draw(sprite);
+    }
+    target.display();
+    atlas = target.getTexture();
+}
+
+///writes the atlas to the pack, so that later starts can skip the images
+bool savePack(uint64_t stamp) {
+    sf::Image image = atlas.copyToImage();
+    return writePack(PACK_FILE, stamp, image.getSize().x, image.getSize().y, image.getPixelsPtr());
+}
+
+void loadCards() {
+    cards.reserve(NUM_CARDS + NUM_VACANT);
+    sf::Vector2i cell_size = cellSize();
+    for (unsigned i = 0; i < NUM_CARDS; ++i) {
+        cards.emplace_back(atlas, atlasCell(i, cell_size), i);
+    }
+    //vacant slots are never drawn, only outlined, but need the size of a card
     for (unsigned i = 0; i < NUM_VACANT; ++i) {
-        cards.emplace_back(card_textures[NUM_CARDS].getTexture(), NUM_CARDS + i);
+        cards.emplace_back(atlas, atlasCell(NUM_CARDS, cell_size), NUM_CARDS + i);
     }
     assert(cards.size() == 63);
 }
 
-int main() {
+///str as a whole as a decimal number, if it is one that fits
+std::optional<uint64_t> parseNumber(const char *str) {
+    uint64_t number;
+    const char *end = str + std::strlen(str);
+    auto [p, ec] = std::from_chars(str, end, number);
+    if (ec != std::errc() || p != end) return {};
+    return number;
+}
+
+int main(int argc, char **argv) {
+    chrono_time_point launched = chrono_clock::now();
+    //the prebaked atlas if it is up to date, otherwise the card images are
+    //decoded while the window opens
+    bool bake = argc > 1 && std::strcmp(argv[1], "--bake") == 0;
+    uint64_t stamp = packStamp();
+    std::optional<MappedFile> pack(std::in_place, PACK_FILE);
+    uint32_t pack_width, pack_height;
+    const unsigned char *pixels = bake ? nullptr : readPack(*pack, stamp, pack_width, pack_height);
+    std::optional<CardDecoder> decoder;
+    if (!pixels) {
+        //a stale pack is rewritten below, which Windows refuses while it is
+        //mapped
+        pack.reset();
+        decoder.emplace();
+    }
+    if (bake) {
+        renderAtlas(decoder->finish());
+        if (!savePack(stamp)) {
+            fprintf(stderr, "failed to write %s\n", PACK_FILE);
+            return 1;
+        }
+        printf("baked %s\n", PACK_FILE);
+        return 0;
+    }
     config.parse(CONFIG_FILE);
-    overall_stats.load(STATS_FILE, config);
-    loadCards();
-    Game game;
+    overall_stats.load(config);
+    //--replay plays back the game with that index in the replay log, the
+    //last one without it
+    std::optional<Replay> replay;
+    if (argc > 1 && std::strcmp(argv[1], "--replay") == 0) {
+        size_t unread;
+        std::vector<Replay> replays = readReplays(REPLAY_FILE, unread);
+        if (replays.empty()) {
+            fprintf(stderr, "no replays in %s\n", REPLAY_FILE);
+            return 1;
+        }
+        std::optional<uint64_t> index = argc > 2 ? parseNumber(argv[2]) : replays.size() - 1;
+        if (!index || *index >= replays.size()) {
+            fprintf(stderr, "no replay %s in %s, which has %zu\n", argv[2], REPLAY_FILE, replays.size());
+            return 1;
+        }
+        replay = replays[*index];
+    }
+    //anything else must be a deal number, a typo would otherwise start deal
+    //0 and throw away the game left running
+    std::optional<uint64_t> number;
+    if (!replay && argc > 1) {
+        number = parseNumber(argv[1]);
+        if (!number) {
+            fprintf(stderr, "usage: %s [deal number | --replay [index] | --bake]\n", argv[0]);
+            return 1;
+        }
+    }
 
     sf::RenderWindow window(sf::VideoMode({WINDOW_WIDTH, WINDOW_HEIGHT}), "SFML");
     std::optional<sf::Vector2u> window_size({WINDOW_WIDTH, WINDOW_HEIGHT});
@@ -622,16 +1208,75 @@ int main() {
             (int)(desktop_size.y - WINDOW_HEIGHT) / 2
     });
     window.setFramerateLimit(FPS);
+    if (pixels) {
+        atlas = sf::Texture({pack_width, pack_height});
+        atlas.update(pixels);
+        pack.reset();
+    } else {
+        renderAtlas(decoder->finish());
+        //without the pack the images are only decoded again next time
+        if (!savePack(stamp)) {
+            fprintf(stderr, "failed to write %s\n", PACK_FILE);
+        }
+    }
+    loadCards();
+    //a deal number on the command line starts that deal, otherwise a game
+    //left running last time goes on
+    std::optional<SaveState> saved;
+    if (!replay && argc == 1) {
+        saved = readNewestSave();
+    }
+    if (!replay && !saved) {
+        removeSaves();
+    }
+    Game game = replay ? Game(replay->deal)
+        : saved ? Game(*saved)
+        : number ? Game(*number)
+        : Game();
+    if (replay) {
+        game.counted = false;
+        playback.start(*replay);
+    }
+    bool first_frame = true;
+#ifdef FRAME_STATS
+    //F3 shows how long the phases of a frame take
+    bool show_frame_stats = false;
+#endif
     std::optional<Range> sel, drag, hover;
     bool was_dragged, reversed, should_close;
     was_dragged = reversed = should_close = false;
     sf::Vector2i last_pos;
+    CardBatch held;
     while (window.isOpen()) {
-        while (const std::optional event = window.pollEvent()) {
+        //when idle, sleep until there is input or the timer ticks; a running
+        //hint search is polled every frame instead
+        std::optional<sf::Event> waited;
+        if (config.idle_rendering && !hint.isSearching()) {
+            waited = window.waitEvent(std::min(game.stats.untilNextTick(), playback.untilNext()));
+        }
+#ifdef FRAME_STATS
+        frame_stats.beginFrame();
+        std::optional<PhaseTimer> events_timer(PHASE_EVENTS);
+#endif
+        for (std::optional event = waited ? waited : window.pollEvent(); event; event = window.pollEvent()) {
             if (should_close || event->is<sf::Event::Closed>()) {
                 window.close();
                 break;
             }
+#ifdef FRAME_STATS
+            if (event->is<sf::Event::KeyPressed>()
+                    || event->is<sf::Event::MouseButtonPressed>()
+                    || event->is<sf::Event::MouseButtonReleased>()
+                    || event->is<sf::Event::MouseMoved>())
+            {
+                frame_stats.input();
+            }
+            if (auto key = event->getIf<sf::Event::KeyPressed>(); key && key->code == sf::Keyboard::Key::F3) {
+                show_frame_stats = !show_frame_stats;
+            }
+#endif
+            //a playback only listens to the keyboard
+            if (playback.isActive() && !event->is<sf::Event::KeyPressed>()) continue;
             bool mouse_left = false;
             bool mouse_right = false;
             bool mouse_left_released = event->is<sf::Event::MouseButtonReleased>();
@@ -648,8 +1293,8 @@ int main() {
                     was_dragged = true;
                     sf::Vector2i delta = pos - last_pos;
                     last_pos = pos;
-                    sf::Vector2f new_pos = cards[*drag->begin].update(delta);
-                    Game::setPilePositions(*drag, new_pos);
+                    sf::Vector2f new_pos = cards[game.front(*drag, reversed)].update(delta);
+                    game.setPilePositions(*drag, new_pos, reversed);
                     int inc_x;
                     if (drag->size() == 1) {
                         inc_x = CARD_WS / 2;
@@ -664,25 +1309,25 @@ int main() {
                     };
                 }
                 if (hover) {
-                    cards[*hover->begin].hovered = false;
-                    cards[hover->end[-1]].hovered = false;
+                    cards[game.front(*hover)].hovered = false;
+                    cards[game.back(*hover)].hovered = false;
                 }
                 hover = game.select(pos);
                 if (hover) {
-                    cards[sel ? hover->end[-1] : *hover->begin].hovered = true;
+                    cards[sel ? game.back(*hover) : game.front(*hover)].hovered = true;
                 }
             } else if (mouse_left || mouse_left_released) {
                 last_pos = sf::Mouse::getPosition(window);
                 if (mouse_left) {
                     if (sel) {
-                        cards[*sel->begin].selected = false;
+                        cards[game.front(*sel, reversed)].selected = false;
                     }
                     hover = game.select(last_pos);
                 }
                 std::optional<Range> last_sel = sel;
                 std::optional<Range> last_hover = hover;
                 if (hover) {
-                    Card &card = cards[*hover->begin];
+                    Card &card = cards[game.front(*hover)];
                     if (mouse_left
                             && !std::holds_alternative<Pile>(hover->place)
                             && (!std::holds_alternative<Cellar>(hover->place) || game.numVacantExtra())
@@ -691,7 +1336,7 @@ int main() {
                         card.selected = true;
                         card.hovered = false;
                         drag = sel = hover;
-                        cards[hover->end[-1]].hovered = false;
+                        cards[game.back(*hover)].hovered = false;
                         hover = {};
                     }
                     if (last_sel && !same(last_sel->place, last_hover->place)) {
@@ -703,15 +1348,8 @@ int main() {
                     sel = {};
                 } 
                 if (was_dragged && drag && mouse_left_released) {
-                    std::vector<char> &row = game.getPlace(drag->place);
-                    Game::setPilePositions(
-                            {row.begin(), row.end(), drag->place},
-                            cards[*row.begin()].sprite.getPosition());
-                    cards[*drag->begin].selected = false;
-                    if (reversed) {
-                        std::reverse(drag->begin, drag->end);
-                        Game::setPilePositions(*drag, cards[drag->end[-1]].sprite.getPosition());
-                    }
+                    game.layout(drag->place);
+                    cards[game.front(*drag, reversed)].selected = false;
                     sel = {};
                 }
                 if (mouse_left_released) {
@@ -723,17 +1361,32 @@ int main() {
                 auto key = event->getIf<sf::Event::KeyPressed>();
                 if (mouse_right || key->code == R) {
                     if (drag && drag->size() > 1 && game.numVacantRows()) {
-                        cards[*drag->begin].selected = false;
-                        std::reverse(drag->begin, drag->end);
-                        Game::setPilePositions(*drag, cards[drag->end[-1]].sprite.getPosition());
-                        cards[*drag->begin].selected = true;
+                        Card &held = cards[game.front(*drag, reversed)];
+                        held.selected = false;
                         reversed = !reversed;
+                        game.setPilePositions(*drag, held.sprite.getPosition(), reversed);
+                        cards[game.front(*drag, reversed)].selected = true;
+                    }
+                } else if (playback.isActive() && key->code == Up) {
+                    playback.faster();
+                } else if (playback.isActive() && key->code == Down) {
+                    playback.slower();
+                } else if (playback.isActive() && key->code == Space) {
+                    playback.togglePause();
+                } else if (std::optional<size_t> n = seekTarget(*key, game); n && !drag && !game.won() && !playback.isActive()) {
+                    if (sel) {
+                        cards[game.front(*sel, reversed)].selected = false;
                     }
-                } else if (key->code == Backspace && config.enable_undo && !drag && game.undo()) {
+                    if (hover) {
+                        cards[game.front(*hover)].hovered = cards[game.back(*hover)].hovered = false;
+                    }
+                    game.seek(*n);
                     drag = hover = sel = {};
+                } else if (key->code == H && !drag && !game.won() && !playback.isActive()) {
+                    hint.request(game.getBoard());
                 } else if (key->code == S && key->control && !drag) {
                     bool reshuffle = true;
-                    if (!game.won()) {
+                    if (!game.won() && game.counted) {
                         sf::Text text(font, "Press Enter to confirm reshuffle", FONT_SIZE);
                         text.setPosition({(WINDOW_WIDTH - text.getGlobalBounds().size.x) / 2, 0});
                         while (true) {
@@ -748,7 +1401,7 @@ int main() {
                                 break;
                             } else if (auto key = event->getIf<sf::Event::KeyPressed>()) {
                                 if (key->code == Enter) {
-                                    overall_stats.recordLoss();
+                                    game.registerLoss();
                                 } else {
                                     reshuffle = false;
                                 }
@@ -760,6 +1413,8 @@ int main() {
                         }
                     }
                     if (reshuffle) {
+                        hint.cancel();
+                        playback.stop();
                         game = Game();
                         drag = hover = sel = {};
                         was_dragged = reversed = false;
@@ -773,19 +1428,71 @@ int main() {
                 //}
             }
         }
+#ifdef FRAME_STATS
+        events_timer.reset();
+#endif
+
+        game.autosave();
 
-        window.clear(COLOR_BG);
-        window.draw(game);
-        if (sel) {
-            for (iterator it = sel->begin; it != sel->end; ++it) {
-                window.draw(cards[*it]);
+        if (std::optional<Move> move = playback.poll()) {
+            if (!game.play(*move)) {
+                fprintf(stderr, "replay breaks the rules at move %zu\n", game.getBoard().getHistory().size());
+                playback.stop();
             }
         }
-        window.display();
+
+        if (std::optional<Move> move = hint.poll()) {
+            //the card to pick up and the one to drop it onto
+            Range from = game.getRange(move->from);
+            from.begin = from.end - move->size;
+            hint.highlight(game.front(from), game.back(game.getRange(move->to)));
+        }
+
+        game.held = sel;
+        {
+            TIME_PHASE(PHASE_DRAW);
+            window.clear(COLOR_BG);
+            window.draw(game);
+            window.draw(hint);
+            window.draw(playback);
+            if (sel) {
+                std::span<const char> row = game.getPlace(sel->place);
+                held.clear();
+                //a reversed range overlaps the other way round
+                for (unsigned i = 0; i < sel->size(); ++i) {
+                    held.add(cards[row[reversed ? sel->end - 1 - i : sel->begin + i]]);
+                }
+                window.draw(held);
+            }
+#ifdef FRAME_STATS
+            if (show_frame_stats) {
+                sf::Text text(font, frame_stats.report(), FONT_SIZE / 2);
+                text.setPosition({0, WINDOW_HEIGHT - text.getGlobalBounds().size.y - FONT_SIZE / 2});
+                window.draw(text);
+            }
+#endif
+        }
+        {
+            TIME_PHASE(PHASE_DISPLAY);
+            window.display();
+        }
+#ifdef FRAME_STATS
+        frame_stats.present();
+#endif
+        if (first_frame) {
+            first_frame = false;
+            auto startup = chrono_clock::now() - launched;
+            printf("first frame after %lld ms\n", (long long)startup.count() / (NSEC_PER_SEC / 1000));
+        }
+    }
+    hint.cancel();
+    if (game.won() || !game.counted) {
+        return 0;
     }
-    if (!game.won() && config.close_is_loss) {
-        overall_stats.recordLoss();
+    if (config.close_is_loss) {
+        game.registerLoss();
+    } else if (!game.save(SAVE_FILE)) {
+        fprintf(stderr, "failed to write %s\n", SAVE_FILE);
     }
-    overall_stats.save(STATS_FILE, config);
     return 0;
 }
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "pack.hpp"
+#include "storage.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char PACK_MAGIC[4] = {'L', 'N', 'P', '1'};
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char *filename) {
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return;
+    bytes = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (bytes) length = file_size.QuadPart;
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            bytes = (const unsigned char *)p;
+            length = st.st_size;
+        }
+    }
+    //the mapping stays valid without the descriptor
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) munmap((void *)bytes, length);
+}
+#endif
+
+const unsigned char *readPack(const MappedFile &file, uint64_t stamp, uint32_t &width, uint32_t &height) {
+    PackHeader header;
+    if (file.size() < sizeof(header)) return nullptr;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) || header.stamp != stamp) {
+        return nullptr;
+    }
+    if (file.size() != sizeof(header) + (size_t)header.width * header.height * 4) {
+        return nullptr;
+    }
+    width = header.width;
+    height = header.height;
+    return file.data() + sizeof(header);
+}
+
+bool writePack(const char *filename, uint64_t stamp, uint32_t width, uint32_t height, const unsigned char *pixels) {
+    PackHeader header = {};
+    std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.width = width;
+    header.height = height;
+    header.stamp = stamp;
+    size_t num_bytes = (size_t)width * height * 4;
+    std::vector<unsigned char> data(sizeof(header) + num_bytes);
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), pixels, num_bytes);
+    return writeAtomically(filename, data);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define PACK_FILE "assets/cards.pack"
+
+///a whole file mapped read-only into memory, empty if it couldn't be opened
+class MappedFile {
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const char *filename);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+///an uncompressed RGBA image, tagged with a stamp of everything it was made
+///from so that a stale one is noticed
+struct PackHeader {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t padding;
+    uint64_t stamp;
+};
+
+///the pixels of the pack in file if its stamp matches, null otherwise
+const unsigned char *readPack(const MappedFile &file, uint64_t stamp, uint32_t &width, uint32_t &height);
+bool writePack(const char *filename, uint64_t stamp, uint32_t width, uint32_t height, const unsigned char *pixels);
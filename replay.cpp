@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include "replay.hpp"
+#include "storage.hpp"
+
+#define REPLAY_MAGIC   "LNRP"
+#define REPLAY_VERSION 1
+#define HEADER_SIZE    8
+///deal, finished, flags and the number of move bytes
+#define PREFIX_SIZE    17
+#define ESCAPE         0xF
+
+static_assert(NUM_PLACES <= ESCAPE, "a place index has to fit in a nibble below the escape");
+
+unsigned realMoves(const Move &move) {
+    return move.size > 1 && !move.reversed ? 2 * move.size : move.size;
+}
+
+void encodeMove(const Move &move, std::vector<unsigned char> &out) {
+    unsigned to = placeIndex(move.to);
+    if (move.size == 1 && !move.reversed) {
+        out.push_back(placeIndex(move.from) << 4 | to);
+        return;
+    }
+    //only runs of a row are picked up as a whole
+    assert(std::holds_alternative<Row>(move.from) && move.size <= 16);
+    out.push_back(ESCAPE << 4 | to);
+    out.push_back(std::get<Row>(move.from).idx << 5 | move.reversed << 4 | (move.size - 1));
+}
+
+std::optional<Move> decodeMove(const unsigned char *&p, const unsigned char *end) {
+    if (p == end) return {};
+    unsigned from = *p >> 4;
+    unsigned to = *p & 0xF;
+    if (to >= NUM_PLACES) return {};
+    if (from != ESCAPE) {
+        if (from >= NUM_PLACES) return {};
+        ++p;
+        return Move(PLACES[from], 1, PLACES[to], false);
+    }
+    if (end - p < 2) return {};
+    unsigned bits = p[1];
+    p += 2;
+    return Move(Row(bits >> 5), (bits & 0xF) + 1, PLACES[to], (bits >> 4 & 1) != 0);
+}
+
+///the replays at the start of data up to the first one that is torn or
+///corrupt, added to replays if it isn't null; returns where that one starts,
+///0 if data doesn't start with a header of ours
+static size_t parse(const std::vector<unsigned char> &data, std::vector<Replay> *replays) {
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), REPLAY_MAGIC, 4)) {
+        return 0;
+    }
+    const unsigned char *p = data.data() + 4;
+    if (get(p, 4) != REPLAY_VERSION) {
+        return 0;
+    }
+    const unsigned char *end = data.data() + data.size();
+    //p stays at the first replay not read yet
+    while (end - p >= PREFIX_SIZE + 4) {
+        const unsigned char *r = p;
+        Replay replay;
+        replay.deal = get(r, 8);
+        replay.finished = get(r, 4);
+        replay.won = get(r, 1);
+        size_t size = get(r, 4);
+        if ((size_t)(end - r) < size + 4) break;
+        const unsigned char *moves_end = r + size;
+        const unsigned char *next = moves_end;
+        if (get(next, 4) != checksum(p, moves_end - p)) break;
+        while (std::optional<Move> move = decodeMove(r, moves_end)) {
+            replay.moves.push_back(*move);
+        }
+        if (r != moves_end) break;
+        if (replays) replays->push_back(std::move(replay));
+        p = next;
+    }
+    return p - data.data();
+}
+
+static std::vector<unsigned char> readFile(const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), {}};
+}
+
+bool ReplayLog::append(const Replay &replay) {
+    std::vector<unsigned char> moves;
+    for (const Move &move : replay.moves) {
+        encodeMove(move, moves);
+    }
+    std::vector<unsigned char> data;
+    ::append(data, replay.deal, 8);
+    ::append(data, replay.finished, 4);
+    ::append(data, replay.won, 1);
+    ::append(data, moves.size(), 4);
+    data.insert(data.end(), moves.begin(), moves.end());
+    ::append(data, checksum(data.data(), data.size()), 4);
+    //a file as long as this log left it holds only whole replays, anything
+    //else is read once to find out where the last whole one ends
+    std::error_code ec;
+    size_t size = std::filesystem::file_size(filename, ec);
+    if (ec) size = 0;
+    if (size != valid) {
+        std::vector<unsigned char> old = readFile(filename.c_str());
+        valid = parse(old, nullptr);
+        if (valid == 0 && old.size() >= HEADER_SIZE) {
+            //another version, which isn't ours to change
+            return false;
+        }
+        //a replay torn by a crash is cut off, or it would hide all that follow
+        if (valid != old.size()) {
+            std::filesystem::resize_file(filename, valid, ec);
+            if (ec) return false;
+        }
+    }
+    FILE *f = std::fopen(filename.c_str(), "ab");
+    if (!f) return false;
+    bool ok = true;
+    if (valid == 0) {
+        std::vector<unsigned char> header(REPLAY_MAGIC, REPLAY_MAGIC + 4);
+        ::append(header, REPLAY_VERSION, 4);
+        ok = std::fwrite(header.data(), 1, HEADER_SIZE, f) == HEADER_SIZE;
+    }
+    ok = ok && std::fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (ok) {
+        valid = std::max<size_t>(valid, HEADER_SIZE) + data.size();
+    } else {
+        //whatever part of it was written is cut off by the next append
+        valid = -1;
+    }
+    return ok;
+}
+
+std::vector<Replay> readReplays(const char *filename, size_t &unread) {
+    std::vector<unsigned char> data = readFile(filename);
+    std::vector<Replay> replays;
+    unread = data.size() - parse(data, &replays);
+    return replays;
+}
+
+const char *verifyReplay(const Replay &replay) {
+    Position position;
+    position.deal(replay.deal);
+    for (const Move &move : replay.moves) {
+        if (position.won()) {
+            return "moves after the win";
+        }
+        if (!position.isLegal(move)) {
+            return "illegal move";
+        }
+        position.apply(move);
+    }
+    if (position.won() != replay.won) {
+        return replay.won ? "claims a win that isn't one" : "claims a loss but is won";
+    }
+    return nullptr;
+}
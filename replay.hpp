@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "rules.hpp"
+
+#define REPLAY_FILE "replays.log"
+
+///a finished game, as its deal and the moves it ended with; undone moves are
+///left out, so that playing them from the deal gives the final position
+struct Replay {
+    uint64_t deal;
+    ///seconds since the epoch when it ended, the same as in its GameRecord
+    uint32_t finished;
+    bool won;
+    std::vector<Move> moves;
+};
+
+///cards moved by move, a run moved in order takes a trip through a vacant
+///row and counts twice
+unsigned realMoves(const Move &move);
+
+///appends move in a single byte, from and to being a place index each, or in
+///two if more than one card moves: 0xF0 | to, then row << 5 | reversed << 4 |
+///size - 1
+void encodeMove(const Move &move, std::vector<unsigned char> &out);
+///the move at p, which is advanced past it, if the bytes up to end hold one
+std::optional<Move> decodeMove(const unsigned char *&p, const unsigned char *end);
+
+///appends replays to a file, cutting off a torn or corrupt replay at its end
+///first so that the ones after it can be read; the file is read through
+///only when it isn't as long as the last append left it
+class ReplayLog {
+    std::string filename;
+    ///the length of the file up to the end of its last whole replay, as
+    ///far as this log knows
+    size_t valid = 0;
+
+public:
+    explicit ReplayLog(const char *filename) : filename(filename) {}
+
+    bool append(const Replay &replay);
+};
+///every replay in filename up to the first one that is torn or corrupt,
+///whose bytes and those after it are counted in unread
+std::vector<Replay> readReplays(const char *filename, size_t &unread);
+///why replay breaks the rules or doesn't end the way it claims, null if it's fine
+const char *verifyReplay(const Replay &replay);
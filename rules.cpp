@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include "rules.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+bool same(Place a, Place b) {
+    size_t i = a.index();
+    if (b.index() != i) {
+        return false;
+    }
+    switch (i) {
+    case 0:
+        return std::get<Row>(a).idx == std::get<Row>(b).idx;
+        break;
+    case 1:
+        return std::get<Extra>(a).idx == std::get<Extra>(b).idx;
+        break;
+    case 2:
+        return true;
+        break;
+    case 3:
+        return std::get<Pile>(a).idx == std::get<Pile>(b).idx;
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+///one key for every card lying on another card or at the bottom of a place,
+///which captures both the place and the order of every card
+static constexpr auto ZOBRIST = [] {
+    std::array<std::array<uint64_t, NUM_CARDS + NUM_PLACES>, NUM_CARDS> keys;
+    uint64_t state = 0x2545f4914f6cdd1d;
+    for (auto &row : keys) {
+        for (uint64_t &key : row) {
+            //splitmix64
+            uint64_t z = (state += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            key = z ^ (z >> 31);
+        }
+    }
+    return keys;
+}();
+
+uint64_t Position::computeHash() const {
+    uint64_t h = 0;
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        unsigned under = NUM_CARDS + i;
+        for (unsigned j = start[i]; j < start[i + 1]; ++j) {
+            h ^= ZOBRIST[cards[j]][under];
+            under = cards[j];
+        }
+    }
+    return h;
+}
+
+///the first place of each kind, which stands in for all places of that kind
+///in the canonical hash
+static constexpr auto KIND = [] {
+    std::array<unsigned char, NUM_PLACES> kind;
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        kind[i] = i < NUM_ROWS ? 0
+            : i < NUM_ROWS + NUM_EXTRA ? NUM_ROWS
+            : i < NUM_VACANT ? NUM_ROWS + NUM_EXTRA
+            : NUM_VACANT;
+    }
+    return kind;
+}();
+
+///for every relabelling of the suits, what every card becomes, and the
+///bottom of every place the bottom of the first place of its kind
+static constexpr auto RELABEL = [] {
+    std::array<std::array<unsigned char, NUM_CARDS + NUM_PLACES>, NUM_SUIT_ORDERS> relabel;
+    //order[k] is the suit that becomes suit k
+    std::array<char, NUM_PILES> order = {0, 1, 2, 3};
+    for (auto &row : relabel) {
+        for (unsigned k = 0; k < NUM_PILES; ++k) {
+            for (unsigned rank = 0; rank < CARDS_PER_SUIT; ++rank) {
+                row[order[k] * CARDS_PER_SUIT + rank] = k * CARDS_PER_SUIT + rank;
+            }
+        }
+        for (unsigned i = 0; i < NUM_PLACES; ++i) {
+            row[NUM_CARDS + i] = NUM_CARDS + KIND[i];
+        }
+        std::next_permutation(order.begin(), order.end());
+    }
+    return relabel;
+}();
+
+//xoring keys of which card lies on which card or kind of bottom leaves out
+//which row, extra or pile it is in
+CanonicalHash::CanonicalHash(const Position &position) {
+    for (unsigned k = 0; k < NUM_SUIT_ORDERS; ++k) {
+        const auto &relabel = RELABEL[k];
+        uint64_t h = 0;
+        for (unsigned i = 0; i < NUM_PLACES; ++i) {
+            for (unsigned j = position.start[i]; j < position.start[i + 1]; ++j) {
+                h ^= ZOBRIST[relabel[position.cards[j]]][relabel[position.below(i, j)]];
+            }
+        }
+        hashes[k] = h;
+    }
+}
+
+void CanonicalHash::update(const Position &position, const Move &move, bool undo) {
+    position.changedLinks(move, undo, [&](unsigned card, unsigned under) {
+        for (unsigned k = 0; k < NUM_SUIT_ORDERS; ++k) {
+            hashes[k] ^= ZOBRIST[RELABEL[k][card]][RELABEL[k][under]];
+        }
+    });
+}
+
+uint64_t Position::canonicalHash() const {
+    return CanonicalHash(*this).get();
+}
+
+Random::Random(uint64_t seed) {
+    for (uint64_t &word : s) {
+        //splitmix64
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        word = z ^ (z >> 31);
+    }
+}
+
+unsigned Random::below(unsigned n) {
+    //Lemire's multiply and shift, rejecting the few biased products
+    uint64_t m = (next() >> 32) * n;
+    if ((uint32_t)m < n) {
+        uint32_t threshold = -n % n;
+        while ((uint32_t)m < threshold) {
+            m = (next() >> 32) * n;
+        }
+    }
+    return m >> 32;
+}
+
+void Random::shuffle(std::span<char> items) {
+    //Brackett-Rozinsky and Lemire, batched ranged random integer generation:
+    //four indices come from each 32 bit half of a word, their product is
+    //small enough that the exact rejection test is almost never needed
+    auto draw4 = [](uint64_t left, unsigned i, unsigned *draws) {
+        for (unsigned j = 0; j < 4; ++j) {
+            uint64_t m = left * (i - j);
+            draws[j] = m >> 32;
+            left = (uint32_t)m;
+        }
+        return left;
+    };
+    unsigned i = items.size();
+    while (i > 8) {
+        unsigned draws[8];
+        uint64_t word = next();
+        uint64_t product_hi = (uint64_t)i * (i - 1) * (i - 2) * (i - 3);
+        uint64_t product_lo = (uint64_t)(i - 4) * (i - 5) * (i - 6) * (i - 7);
+        uint64_t left_hi = draw4(word >> 32, i, draws);
+        uint64_t left_lo = draw4((uint32_t)word, i - 4, draws + 4);
+        if ((left_hi < product_hi && left_hi < (uint32_t)-product_hi % product_hi)
+                || (left_lo < product_lo && left_lo < (uint32_t)-product_lo % product_lo))
+        {
+            continue;
+        }
+        for (unsigned j = 0; j < 8; ++j) {
+            std::swap(items[i - 1 - j], items[draws[j]]);
+        }
+        i -= 8;
+    }
+    for (; i > 1; --i) {
+        std::swap(items[i - 1], items[below(i)]);
+    }
+}
+
+void Random::jump() {
+    static const uint64_t JUMP[] = {
+        0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c,
+    };
+    uint64_t t[4] = {};
+    for (uint64_t jump : JUMP) {
+        for (int b = 0; b < 64; ++b) {
+            if (jump & (uint64_t)1 << b) {
+                for (int i = 0; i < 4; ++i) {
+                    t[i] ^= s[i];
+                }
+            }
+            next();
+        }
+    }
+    std::memcpy(s, t, sizeof(s));
+}
+
+static constexpr auto DEAL_START = [] {
+    std::array<unsigned char, NUM_PLACES + 1> start;
+    start[0] = 0;
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        unsigned size = i < NUM_ROWS ? 5
+            : i < NUM_ROWS + NUM_EXTRA ? 4
+            : i == placeIndex(Cellar()) ? 0
+            : 1;
+        start[i + 1] = start[i] + size;
+    }
+    return start;
+}();
+
+static_assert(DEAL_START[NUM_PLACES] == NUM_CARDS);
+
+#define DEALT_CARDS (NUM_CARDS - NUM_PILES)
+
+///for every rank the piles may start with, the other cards in order
+static constexpr auto DECKS = [] {
+    std::array<std::array<char, DEALT_CARDS>, CARDS_PER_SUIT> decks;
+    for (char c = 0; c < CARDS_PER_SUIT; ++c) {
+        unsigned n = 0;
+        for (char card = 0; card < NUM_CARDS; ++card) {
+            if (CARD_INFO[card].rank != c) {
+                decks[c][n++] = card;
+            }
+        }
+    }
+    return decks;
+}();
+
+static_assert(DEAL_START[placeIndex(Cellar())] == DEALT_CARDS);
+
+void Position::deal(Random &random) {
+    //the piles start with the rank of the last card of a shuffled deck and
+    //the other 48 cards are dealt in random order, so pick the rank first
+    //and shuffle the rest straight into rows and extras
+    char c = random.below(CARDS_PER_SUIT);
+    std::memcpy(cards.data(), DECKS[c].data(), DEALT_CARDS);
+    start = DEAL_START;
+    random.shuffle({cards.data(), DEALT_CARDS});
+    for (unsigned i = 0; i < NUM_PILES; ++i) {
+        cards[start[placeIndex(Pile(i))]] = c + i * CARDS_PER_SUIT;
+    }
+    hash = computeHash();
+    computeFacts();
+}
+
+void Position::deal(uint64_t number) {
+    Random random(number);
+    deal(random);
+}
+
+unsigned Position::scanRun(unsigned i, unsigned limit) const {
+    unsigned size = start[i + 1] - start[i];
+    if (size == 0) return 0;
+    unsigned top = start[i + 1] - 1;
+    unsigned length = 1;
+    while (length < size && length < limit && fits(cards[top - length], cards[top - length + 1])) {
+        ++length;
+    }
+    return length;
+}
+
+void Position::computeFacts() {
+    vacant_rows = vacant_extra = 0;
+    for (unsigned i = 0; i < NUM_ROWS; ++i) {
+        vacant_rows += start[i] == start[i + 1];
+        run[i] = scanRun(i);
+    }
+    for (unsigned i = NUM_ROWS; i < NUM_ROWS + NUM_EXTRA; ++i) {
+        vacant_extra += start[i] == start[i + 1];
+    }
+}
+
+bool Position::factsUpToDate() const {
+    Position fresh = *this;
+    fresh.computeFacts();
+    return fresh.vacant_rows == vacant_rows && fresh.vacant_extra == vacant_extra && fresh.run == run;
+}
+
+bool Position::isRun(Place place, unsigned size) const {
+    std::span<const char> row = getPlace(place);
+    assert(size <= row.size());
+    if (std::holds_alternative<Row>(place)) {
+        return size <= run[placeIndex(place)];
+    }
+    for (auto it = row.end() - size; size > 1 && it != row.end() - 1; ++it) {
+        if (!fits(it[0], it[1])) return false;
+    }
+    return true;
+}
+
+bool Position::canPick(Place from, unsigned size) const {
+    if (size == 0 || size > this->size(from)) {
+        return false;
+    }
+    switch (from.index()) {
+    case 0:
+        return size == 1 || (numVacantRows() && isRun(from, size));
+    case 1:
+        return size == 1;
+    case 2:
+        return numVacantExtra() > 0;
+    default:
+        return false;
+    }
+}
+
+bool Position::isLegal(const Move &move) const {
+    if (same(move.from, move.to) || !canPick(move.from, move.size)) {
+        return false;
+    }
+    if (move.reversed && (move.size == 1 || !numVacantRows())) {
+        return false;
+    }
+    std::span<const char> row_from = getPlace(move.from);
+    std::span<const char> row_to = getPlace(move.to);
+    char first = move.reversed ? row_from.back() : *(row_from.end() - move.size);
+    if (std::holds_alternative<Cellar>(move.to)) {
+        return row_to.empty()
+            && move.size == 1
+            && !std::holds_alternative<Extra>(move.from);
+    }
+    if (std::holds_alternative<Pile>(move.to)) {
+        return fits(row_to.back(), first);
+    }
+    if (std::holds_alternative<Row>(move.to)) {
+        if (row_to.empty()) {
+            return move.size == 1 || numVacantRows() >= 2 || move.reversed;
+        }
+        return fits(row_to.back(), first);
+    }
+    return false;
+}
+
+///bit t of masks[s] is set if the top card of place t fits onto firsts[s];
+///tops has one entry per place, -1 for empty places and the padding
+using FitMasks = void (*)(const char *tops, const char *firsts, unsigned n, uint16_t *masks);
+
+static void fitMasksScalar(const char *tops, const char *firsts, unsigned n, uint16_t *masks) {
+    for (unsigned s = 0; s < n; ++s) {
+        const CardInfo &info = CARD_INFO[firsts[s]];
+        uint16_t mask = 0;
+        for (unsigned t = 0; t < NUM_PLACES; ++t) {
+            mask |= (tops[t] == info.next || tops[t] == info.prev) << t;
+        }
+        masks[s] = mask;
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+//SSE2 is part of x86-64, AVX2 is checked for when the program starts
+static void fitMasksSse2(const char *tops, const char *firsts, unsigned n, uint16_t *masks) {
+    __m128i t = _mm_loadu_si128((const __m128i *)tops);
+    for (unsigned s = 0; s < n; ++s) {
+        const CardInfo &info = CARD_INFO[firsts[s]];
+        __m128i next = _mm_cmpeq_epi8(t, _mm_set1_epi8(info.next));
+        __m128i prev = _mm_cmpeq_epi8(t, _mm_set1_epi8(info.prev));
+        masks[s] = _mm_movemask_epi8(_mm_or_si128(next, prev));
+    }
+}
+
+#if defined(__GNUC__)
+//two sources at once, one in each half
+__attribute__((target("avx2")))
+static void fitMasksAvx2(const char *tops, const char *firsts, unsigned n, uint16_t *masks) {
+    __m256i t = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tops));
+    unsigned s = 0;
+    for (; s + 2 <= n; s += 2) {
+        const CardInfo &a = CARD_INFO[firsts[s]];
+        const CardInfo &b = CARD_INFO[firsts[s + 1]];
+        __m256i next = _mm256_cmpeq_epi8(t, _mm256_setr_m128i(_mm_set1_epi8(a.next), _mm_set1_epi8(b.next)));
+        __m256i prev = _mm256_cmpeq_epi8(t, _mm256_setr_m128i(_mm_set1_epi8(a.prev), _mm_set1_epi8(b.prev)));
+        uint32_t both = _mm256_movemask_epi8(_mm256_or_si256(next, prev));
+        masks[s] = both;
+        masks[s + 1] = both >> 16;
+    }
+    fitMasksSse2(tops, firsts + s, n - s, masks + s);
+}
+#endif
+#endif
+
+bool fitKernelSupported(FitKernel kernel) {
+    switch (kernel) {
+    case FitKernel::Scalar:
+        return true;
+#if defined(__x86_64__) || defined(_M_X64)
+    case FitKernel::Sse2:
+        return true;
+#if defined(__GNUC__)
+    case FitKernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#endif
+    default:
+        return false;
+    }
+}
+
+static FitMasks kernelFunction(FitKernel kernel) {
+    switch (kernel) {
+#if defined(__x86_64__) || defined(_M_X64)
+    case FitKernel::Sse2:
+        return fitMasksSse2;
+#if defined(__GNUC__)
+    case FitKernel::Avx2:
+        return fitMasksAvx2;
+#endif
+#endif
+    default:
+        return fitMasksScalar;
+    }
+}
+
+static FitKernel fit_kernel = [] {
+    for (FitKernel kernel : {FitKernel::Avx2, FitKernel::Sse2}) {
+        if (fitKernelSupported(kernel)) return kernel;
+    }
+    return FitKernel::Scalar;
+}();
+static FitMasks fitMasks = kernelFunction(fit_kernel);
+
+bool useFitKernel(FitKernel kernel) {
+    if (!fitKernelSupported(kernel)) return false;
+    fit_kernel = kernel;
+    fitMasks = kernelFunction(kernel);
+    return true;
+}
+
+FitKernel currentFitKernel() {
+    return fit_kernel;
+}
+
+void Position::generateMoves(MoveList &moves) const {
+    moves.count = 0;
+    struct Source {
+        unsigned char from;
+        unsigned char size;
+        bool reversed;
+    };
+    //every run suffix of every row both ways, the extras and the cellar,
+    //with the card of each that ends up on the target
+    Source sources[2 * NUM_CARDS + NUM_EXTRA + 1];
+    char firsts[2 * NUM_CARDS + NUM_EXTRA + 1];
+    unsigned num_sources = 0;
+    auto add = [&](unsigned from, unsigned size, char first, bool reversed) {
+        sources[num_sources] = {(unsigned char)from, (unsigned char)size, reversed};
+        firsts[num_sources++] = first;
+    };
+    for (unsigned i = 0; i < NUM_ROWS; ++i) {
+        if (start[i] == start[i + 1]) continue;
+        unsigned top = start[i + 1] - 1;
+        add(i, 1, cards[top], false);
+        if (!vacant_rows) continue;
+        for (unsigned size = 2; size <= run[i]; ++size) {
+            add(i, size, cards[top + 1 - size], false);
+            add(i, size, cards[top], true);
+        }
+    }
+    for (unsigned i = NUM_ROWS; i < NUM_ROWS + NUM_EXTRA; ++i) {
+        if (start[i] == start[i + 1]) continue;
+        add(i, 1, cards[start[i + 1] - 1], false);
+    }
+    const unsigned cellar = placeIndex(Cellar());
+    bool cellar_empty = start[cellar] == start[cellar + 1];
+    if (!cellar_empty && vacant_extra) {
+        add(cellar, 1, cards[start[cellar]], false);
+    }
+    //which tops fit onto which sources, all at once
+    alignas(16) char tops[16];
+    std::memset(tops, -1, sizeof(tops));
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        if (start[i] != start[i + 1]) {
+            tops[i] = cards[start[i + 1] - 1];
+        }
+    }
+    uint16_t masks[2 * NUM_CARDS + NUM_EXTRA + 1];
+    fitMasks(tops, firsts, num_sources, masks);
+    const uint16_t PILES = ((1 << NUM_PILES) - 1) << NUM_VACANT;
+    const uint16_t ROWS = (1 << NUM_ROWS) - 1;
+    auto push = [&](const Source &source, uint16_t targets) {
+        for (; targets; targets &= targets - 1) {
+            moves.push(PLACES[source.from], source.size, PLACES[std::countr_zero(targets)], source.reversed);
+        }
+    };
+    for (unsigned i = 0; i < num_sources; ++i) {
+        push(sources[i], masks[i] & PILES);
+    }
+    for (unsigned i = 0; i < num_sources; ++i) {
+        push(sources[i], masks[i] & ROWS & ~(1 << sources[i].from));
+    }
+    if (cellar_empty) {
+        for (unsigned i = 0; i < num_sources; ++i) {
+            const Source &source = sources[i];
+            if (source.from < NUM_ROWS && source.size == 1) {
+                moves.push(PLACES[source.from], 1, Cellar(), false);
+            }
+        }
+    }
+    if (vacant_rows) {
+        uint16_t vacant = 0;
+        for (unsigned j = 0; j < NUM_ROWS; ++j) {
+            vacant |= (start[j] == start[j + 1]) << j;
+        }
+        for (unsigned i = 0; i < num_sources; ++i) {
+            const Source &source = sources[i];
+            if (source.size > 1 && vacant_rows < 2 && !source.reversed) continue;
+            push(source, vacant);
+        }
+    }
+}
+
+void Position::transfer(unsigned from, unsigned size, unsigned to, bool reversed) {
+    char moved[NUM_CARDS];
+    unsigned src = start[from + 1] - size;
+    std::memcpy(moved, &cards[src], size);
+    changedLinks(from, size, to, reversed, [&](unsigned card, unsigned under) {
+        hash ^= ZOBRIST[card][under];
+    });
+    unsigned size_from = start[from + 1] - start[from];
+    unsigned size_to = start[to + 1] - start[to];
+    if (from < NUM_ROWS) {
+        vacant_rows += size == size_from;
+    } else if (from < NUM_ROWS + NUM_EXTRA) {
+        vacant_extra += size == size_from;
+    }
+    if (to < NUM_ROWS) {
+        vacant_rows -= size_to == 0;
+    } else if (to < NUM_ROWS + NUM_EXTRA) {
+        vacant_extra -= size_to == 0;
+    }
+    if (from < to) {
+        std::memmove(&cards[src], &cards[start[from + 1]], start[to + 1] - start[from + 1]);
+        for (unsigned i = from + 1; i <= to; ++i) {
+            start[i] -= size;
+        }
+    } else {
+        std::memmove(&cards[start[to + 1] + size], &cards[start[to + 1]], src - start[to + 1]);
+        for (unsigned i = to + 1; i <= from; ++i) {
+            start[i] += size;
+        }
+    }
+    char *dst = &cards[start[to + 1] - size];
+    if (reversed) {
+        std::reverse_copy(moved, moved + size, dst);
+    } else {
+        std::memcpy(dst, moved, size);
+    }
+    //what is left of a longer run stays one, otherwise look at the new top;
+    //the moved cards extend the run below them only if they all form one
+    if (from < NUM_ROWS) {
+        run[from] = run[from] > size ? run[from] - size : scanRun(from);
+    }
+    if (to < NUM_ROWS) {
+        unsigned length = scanRun(to, size + 1);
+        run[to] = length > size ? size + run[to] : length;
+    }
+    assert(hash == computeHash());
+    assert(factsUpToDate());
+}
+
+void Position::apply(const Move &move) {
+    transfer(placeIndex(move.from), move.size, placeIndex(move.to), move.reversed);
+}
+
+void Position::revert(const Move &move) {
+    transfer(placeIndex(move.to), move.size, placeIndex(move.from), move.reversed);
+}
+
+bool Position::won() const {
+    return numOutside() == 0;
+}
+
+void Board::deal(uint64_t number) {
+    Position::deal(number);
+    this->number = number;
+    history.clear();
+    undone.clear();
+}
+
+void Board::resume(uint64_t number, const Position &position, std::vector<Move> history) {
+    Position::operator=(position);
+    this->number = number;
+    this->history = std::move(history);
+    undone.clear();
+}
+
+bool Board::tryMove(const Move &move) {
+    if (!isLegal(move)) {
+        return false;
+    }
+    apply(move);
+    history.push_back(move);
+    undone.clear();
+    return true;
+}
+
+std::optional<Move> Board::undo() {
+    if (history.empty()) return {};
+    Move move = history.back();
+    history.pop_back();
+    revert(move);
+    undone.push_back(move);
+    return move;
+}
+
+std::optional<Move> Board::redo() {
+    if (undone.empty()) return {};
+    Move move = undone.back();
+    undone.pop_back();
+    apply(move);
+    history.push_back(move);
+    return move;
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#define CARDS_PER_SUIT 13
+#define NUM_ROWS       8
+#define NUM_EXTRA      2
+#define NUM_PILES      4
+#define NUM_VACANT     (NUM_ROWS + NUM_EXTRA + 1)
+#define NUM_PLACES     (NUM_VACANT + NUM_PILES)
+
+const char NUM_CARDS = 4 * CARDS_PER_SUIT;
+
+enum Suit {
+    Clubs,
+    Hearts,
+    Spades,
+    Diamonds,
+};
+
+enum FaceCard {
+    King,
+    Ace,
+    Jack = 11,
+    Queen,
+};
+
+struct CardInfo {
+    char suit;
+    char rank;
+    ///the cards one rank up and down in the same suit, King and Ace
+    ///being neighbours
+    char next;
+    char prev;
+};
+
+///everything the rules ask about a card, worked out at compile time
+constexpr auto CARD_INFO = [] {
+    std::array<CardInfo, NUM_CARDS> info;
+    for (char card = 0; card < NUM_CARDS; ++card) {
+        char suit = card / CARDS_PER_SUIT;
+        char rank = card % CARDS_PER_SUIT;
+        info[card] = {
+            suit,
+            rank,
+            (char)(suit * CARDS_PER_SUIT + (rank + 1) % CARDS_PER_SUIT),
+            (char)(suit * CARDS_PER_SUIT + (rank + CARDS_PER_SUIT - 1) % CARDS_PER_SUIT),
+        };
+    }
+    return info;
+}();
+
+///bit b of FITS[a] is set if b may lie on a, which is symmetric
+constexpr auto FITS = [] {
+    std::array<uint64_t, NUM_CARDS> fits{};
+    for (char card = 0; card < NUM_CARDS; ++card) {
+        fits[card] = (uint64_t)1 << CARD_INFO[card].next | (uint64_t)1 << CARD_INFO[card].prev;
+    }
+    return fits;
+}();
+
+constexpr bool fits(char a, char b) {
+    return FITS[a] >> b & 1;
+}
+
+static_assert(fits(King, Ace) && fits(Queen, King) && !fits(Ace, Ace) && !fits(Queen, CARDS_PER_SUIT + King));
+
+struct Row {
+    char idx;
+};
+
+struct Extra {
+    char idx;
+};
+
+struct Cellar {};
+
+struct Pile {
+    char idx;
+};
+
+using Place = std::variant<Row, Extra, Cellar, Pile>;
+
+bool same(Place a, Place b);
+
+///rows, extras and the cellar come first, so that their index doubles as
+///the index of their vacant slot
+constexpr unsigned placeIndex(Place place) {
+    switch (place.index()) {
+    case 0:
+        return std::get<Row>(place).idx;
+    case 1:
+        return NUM_ROWS + std::get<Extra>(place).idx;
+    case 2:
+        return NUM_ROWS + NUM_EXTRA;
+    default:
+        return NUM_VACANT + std::get<Pile>(place).idx;
+    }
+}
+
+///the place with each index, the inverse of placeIndex
+constexpr auto PLACES = [] {
+    std::array<Place, NUM_PLACES> places;
+    for (char i = 0; i < NUM_ROWS; ++i) places[placeIndex(Row(i))] = Row(i);
+    for (char i = 0; i < NUM_EXTRA; ++i) places[placeIndex(Extra(i))] = Extra(i);
+    places[placeIndex(Cellar())] = Cellar();
+    for (char i = 0; i < NUM_PILES; ++i) places[placeIndex(Pile(i))] = Pile(i);
+    return places;
+}();
+
+struct Move {
+    Place from;
+    unsigned size;
+    Place to;
+    bool reversed;
+};
+
+///no position has more legal moves: the first card of a source fits at most
+///two tops, and with v vacant rows every source also goes into each of them.
+///n non-empty rows hold runs of at most 13 and 48 cards in all, giving
+///min(25n, 96 - n) row sources plus 3 for the extras and cellar, and each
+///row single may go to the cellar; n = 4 and v = 4 is the worst, 95 * 6 + 4
+#define MAX_MOVES 574
+
+///fixed capacity buffer meant to live on the stack, the moves are left
+///uninitialized until pushed
+struct MoveList {
+    union {
+        Move moves[MAX_MOVES];
+    };
+    unsigned count = 0;
+
+    MoveList() {}
+
+    void push(Place from, unsigned size, Place to, bool reversed) {
+        assert(count < MAX_MOVES);
+        new (&moves[count++]) Move(from, size, to, reversed);
+    }
+
+    const Move *begin() const { return moves; }
+    const Move *end() const { return moves + count; }
+    unsigned size() const { return count; }
+    const Move &operator[](unsigned i) const { return moves[i]; }
+};
+
+///xoshiro256**, the same seed always gives the same deals on every platform
+class Random {
+    uint64_t s[4];
+
+public:
+    explicit Random(uint64_t seed);
+
+    uint64_t next() {
+        auto rotl = [](uint64_t x, int k) { return (x << k) | (x >> (64 - k)); };
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    ///uniform in [0, n)
+    unsigned below(unsigned n);
+    ///Fisher-Yates, drawing as many indices from one 32 bit word as fit
+    void shuffle(std::span<char> items);
+    ///advances by 2^128 numbers, so that workers calling it 1, 2, ... times
+    ///on copies of one generator draw from disjoint streams
+    void jump();
+};
+
+///the cards of all places back to back in the order of placeIndex,
+///so that copying a position is a single memcpy
+struct Position {
+    ///Zobrist hash of which card lies on which, kept up to date by every move
+    uint64_t hash;
+    std::array<char, NUM_CARDS> cards;
+    ///place i occupies cards[start[i]] up to cards[start[i + 1]]
+    std::array<unsigned char, NUM_PLACES + 1> start;
+    ///facts about the cards above, kept up to date by every move like hash
+    char vacant_rows;
+    char vacant_extra;
+    ///how many cards on top of each row form a run
+    std::array<unsigned char, NUM_ROWS> run;
+
+    void deal(Random &random);
+    ///deal number n is always the same layout
+    void deal(uint64_t number);
+
+    std::span<const char> getPlace(Place place) const {
+        unsigned i = placeIndex(place);
+        return {cards.data() + start[i], cards.data() + start[i + 1]};
+    }
+
+    uint64_t getHash() const { return hash; }
+    uint64_t computeHash() const;
+    ///the same for all positions that only differ in the order of the rows,
+    ///of the extras or of the piles, or in which suit is which, since none of
+    ///those matter to the rules; CanonicalHash keeps it up to date
+    uint64_t canonicalHash() const;
+
+    ///what the card at index j of place i lies on: the card below it, or
+    ///NUM_CARDS + i for the bottom of the place
+    unsigned below(unsigned i, unsigned j) const {
+        return j == start[i] ? NUM_CARDS + i : cards[j - 1];
+    }
+
+    ///calls link(card, under) for every card that apply(move), or
+    ///revert(move) if undo, puts onto something else, once with what it
+    ///lies on now and once with what it will lie on
+    template<typename F>
+    void changedLinks(const Move &move, bool undo, F link) const {
+        unsigned from = placeIndex(undo ? move.to : move.from);
+        unsigned to = placeIndex(undo ? move.from : move.to);
+        changedLinks(from, move.size, to, move.reversed, link);
+    }
+
+    unsigned size(Place place) const {
+        unsigned i = placeIndex(place);
+        return start[i + 1] - start[i];
+    }
+
+    char numVacantRows() const { return vacant_rows; }
+    char numVacantExtra() const { return vacant_extra; }
+    ///cards not yet on the piles
+    unsigned numOutside() const { return start[NUM_VACANT]; }
+
+    ///whether the top size cards of place form a run
+    bool isRun(Place place, unsigned size) const;
+
+    ///whether the top size cards of from may be picked up at all
+    bool canPick(Place from, unsigned size) const;
+    bool isLegal(const Move &move) const;
+    ///every move isLegal accepts: onto piles first, then onto cards in rows,
+    ///into the cellar and into vacant rows
+    void generateMoves(MoveList &moves) const;
+
+    ///applies move without checking it
+    void apply(const Move &move);
+    ///takes back move, which has to be the last one applied
+    void revert(const Move &move);
+
+    bool won() const;
+
+private:
+    ///length of the run on top of place i, looking at no more than limit cards
+    unsigned scanRun(unsigned i, unsigned limit = NUM_CARDS) const;
+    ///sets vacant_rows, vacant_extra and run from scratch
+    void computeFacts();
+    bool factsUpToDate() const;
+    void transfer(unsigned from, unsigned size, unsigned to, bool reversed);
+
+    template<typename F>
+    void changedLinks(unsigned from, unsigned size, unsigned to, bool reversed, F link) const {
+        unsigned src = start[from + 1] - size;
+        const char *moved = &cards[src];
+        unsigned under_from = below(from, src);
+        unsigned under_to = below(to, start[to + 1]);
+        //only the bottom card of the moved cards changes what it lies on,
+        //unless their order is reversed
+        if (reversed) {
+            link(moved[0], under_from);
+            link(moved[size - 1], under_to);
+            for (unsigned i = 1; i < size; ++i) {
+                link(moved[i], moved[i - 1]);
+                link(moved[i - 1], moved[i]);
+            }
+        } else {
+            link(moved[0], under_from);
+            link(moved[0], under_to);
+        }
+    }
+};
+
+///the ways generateMoves can work out which cards fit onto which; the best
+///one the CPU has is picked when the program starts
+enum class FitKernel {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+bool fitKernelSupported(FitKernel kernel);
+///makes generateMoves use kernel from then on if the CPU has it, which must
+///not happen while another thread generates moves
+bool useFitKernel(FitKernel kernel);
+FitKernel currentFitKernel();
+
+static_assert(std::is_trivially_copyable_v<Position>);
+static_assert(sizeof(Position) <= 128, "a position should fit in two cache lines");
+
+///the ways to relabel the four suits
+#define NUM_SUIT_ORDERS 24
+
+///Position::canonicalHash kept up to date move by move like the Zobrist
+///hash: the hash under every relabelling of the suits, with the bottom of
+///every place standing for the first place of its kind, the smallest of
+///which is the same for all positions equal up to those symmetries
+class CanonicalHash {
+    std::array<uint64_t, NUM_SUIT_ORDERS> hashes;
+
+public:
+    explicit CanonicalHash(const Position &position);
+
+    ///follows position through apply(move), or revert(move) if undo; it has
+    ///to be called before
+    void update(const Position &position, const Move &move, bool undo = false);
+
+    uint64_t get() const {
+        return *std::min_element(hashes.begin(), hashes.end());
+    }
+};
+
+///a position together with the moves that led to it
+class Board : public Position {
+    std::vector<Move> history;
+    ///moves taken back since the last new one, the latest at the back
+    std::vector<Move> undone;
+    uint64_t number = 0;
+
+public:
+    void deal(uint64_t number);
+    ///continues a game of deal number that reached position by history
+    void resume(uint64_t number, const Position &position, std::vector<Move> history);
+
+    uint64_t getDealNumber() const { return number; }
+    const std::vector<Move> &getHistory() const { return history; }
+
+    ///moves redo can make again
+    size_t numUndone() const { return undone.size(); }
+
+    ///applies and records move if it is legal, which forgets the undone moves
+    bool tryMove(const Move &move);
+    std::optional<Move> undo();
+    ///makes the last undone move again
+    std::optional<Move> redo();
+};
@@ -0,0 +1,82 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "save.hpp"
+#include "storage.hpp"
+
+#define SAVE_MAGIC   "LNGS"
+#define SAVE_VERSION 1
+
+static_assert(std::is_trivially_copyable_v<SaveHeader>);
+static_assert(std::is_trivially_copyable_v<Move>);
+
+//the bytes of another build or of a machine of the other endianness give
+//another number
+static const uint32_t LAYOUT = SAVE_VERSION | sizeof(SaveHeader) << 8 | sizeof(Move) << 20;
+
+std::string autosaveFile(unsigned slot) {
+    return "autosave" + std::to_string(slot) + ".sav";
+}
+
+bool writeSave(const char *filename, const SaveState &state) {
+    SaveHeader header = state.header;
+    std::memcpy(header.magic, SAVE_MAGIC, 4);
+    header.layout = LAYOUT;
+    header.num_history = state.history.size();
+    std::vector<unsigned char> data(sizeof(header) + state.history.size() * sizeof(Move));
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), state.history.data(), state.history.size() * sizeof(Move));
+    //the checksum covers the padding as it was written, with the field
+    //itself taken as 0
+    std::memset(data.data() + offsetof(SaveHeader, checksum), 0, sizeof(uint32_t));
+    uint32_t sum = checksum(data.data(), data.size());
+    std::memcpy(data.data() + offsetof(SaveHeader, checksum), &sum, sizeof(sum));
+    return writeAtomically(filename, data);
+}
+
+std::optional<SaveState> readSave(const char *filename) {
+    std::error_code ec;
+    size_t size = std::filesystem::file_size(filename, ec);
+    if (ec || size < sizeof(SaveHeader)) return {};
+    std::vector<unsigned char> data(size);
+    FILE *f = std::fopen(filename, "rb");
+    if (!f) return {};
+    size_t read = std::fread(data.data(), 1, size, f);
+    std::fclose(f);
+    SaveState state;
+    std::memcpy(&state.header, data.data(), sizeof(SaveHeader));
+    const SaveHeader &header = state.header;
+    //as it was when the checksum was taken
+    std::memset(data.data() + offsetof(SaveHeader, checksum), 0, sizeof(uint32_t));
+    if (read != size
+            || std::memcmp(header.magic, SAVE_MAGIC, 4)
+            || header.layout != LAYOUT
+            || size != sizeof(SaveHeader) + (size_t)header.num_history * sizeof(Move)
+            || checksum(data.data(), size) != header.checksum)
+    {
+        return {};
+    }
+    state.history.resize(header.num_history);
+    std::memcpy(state.history.data(), data.data() + sizeof(SaveHeader), header.num_history * sizeof(Move));
+    return state;
+}
+
+std::optional<SaveState> readNewestSave() {
+    std::optional<SaveState> newest = readSave(SAVE_FILE);
+    for (unsigned slot = 0; slot < AUTOSAVE_SLOTS; ++slot) {
+        std::optional<SaveState> state = readSave(autosaveFile(slot).c_str());
+        if (state && (!newest || state->header.sequence > newest->header.sequence)) {
+            newest = std::move(state);
+        }
+    }
+    return newest;
+}
+
+void removeSaves() {
+    std::error_code ec;
+    std::filesystem::remove(SAVE_FILE, ec);
+    for (unsigned slot = 0; slot < AUTOSAVE_SLOTS; ++slot) {
+        std::filesystem::remove(autosaveFile(slot), ec);
+    }
+}
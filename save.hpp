@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "rules.hpp"
+
+///the game left running when the window was closed
+#define SAVE_FILE      "game.sav"
+///autosaves take turns in this many files, so that a crash while writing
+///one leaves the others intact
+#define AUTOSAVE_SLOTS 4
+///seconds between autosaves of a game that changed
+#define AUTOSAVE_SECS  5
+
+///a game in progress as it lies in memory, followed in the file by
+///num_history moves; reading it back is a single read and a copy, so a save
+///only fits the build that wrote it, anything else is recognized and ignored
+struct SaveHeader {
+    char magic[4];
+    ///the version and the sizes of the header and of a move
+    uint32_t layout;
+    ///counts up with every save of a game, the newest one is resumed
+    uint64_t sequence;
+    uint64_t deal;
+    Position position;
+    uint32_t elapsed_ms;
+    uint32_t moves;
+    uint32_t real_moves;
+    uint32_t consecutive_undos;
+    uint32_t num_history;
+    bool used_undo;
+    ///of the whole file with this field 0
+    uint32_t checksum;
+};
+
+struct SaveState {
+    SaveHeader header;
+    std::vector<Move> history;
+};
+
+///the file of autosave slot i
+std::string autosaveFile(unsigned slot);
+///replaces filename as a whole or, if it fails, not at all
+bool writeSave(const char *filename, const SaveState &state);
+std::optional<SaveState> readSave(const char *filename);
+///the newest intact save among SAVE_FILE and the autosaves
+std::optional<SaveState> readNewestSave();
+///removes SAVE_FILE and the autosaves, once the game they hold is over
+void removeSaves();
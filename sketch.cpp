@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "sketch.hpp"
+
+static const double GAMMA = (1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY);
+static const double LOG_GAMMA = std::log(GAMMA);
+
+static unsigned bucketOf(uint32_t value) {
+    if (value == 0) return 0;
+    return 1 + (unsigned)std::ceil(std::log(value) / LOG_GAMMA);
+}
+
+///the value in the middle of bucket, off by at most SKETCH_ACCURACY from
+///everything in it
+static uint32_t valueOf(unsigned bucket) {
+    if (bucket == 0) return 0;
+    double upper = std::pow(GAMMA, bucket - 1.0);
+    return std::max(1.0, std::round(2 * upper / (GAMMA + 1)));
+}
+
+Sketch::Sketch(unsigned first, std::vector<uint32_t> counts)
+    : buckets(std::move(counts)),
+      first(first),
+      count(std::accumulate(buckets.begin(), buckets.end(), (uint32_t)0))
+{}
+
+void Sketch::add(uint32_t value) {
+    unsigned bucket = bucketOf(value);
+    if (buckets.empty()) {
+        first = bucket;
+    } else if (bucket < first) {
+        buckets.insert(buckets.begin(), first - bucket, 0);
+        first = bucket;
+    }
+    if (bucket - first >= buckets.size()) {
+        buckets.resize(bucket - first + 1);
+    }
+    ++buckets[bucket - first];
+    ++count;
+}
+
+void Sketch::merge(const Sketch &other) {
+    if (other.buckets.empty()) return;
+    if (buckets.empty()) {
+        *this = other;
+        return;
+    }
+    if (other.first < first) {
+        buckets.insert(buckets.begin(), first - other.first, 0);
+        first = other.first;
+    }
+    unsigned end = other.first + other.buckets.size();
+    if (end - first > buckets.size()) {
+        buckets.resize(end - first);
+    }
+    for (size_t i = 0; i < other.buckets.size(); ++i) {
+        buckets[other.first - first + i] += other.buckets[i];
+    }
+    count += other.count;
+}
+
+void Sketch::clear() {
+    buckets.clear();
+    first = 0;
+    count = 0;
+}
+
+uint32_t Sketch::quantile(double q) const {
+    if (count == 0) return 0;
+    //the value of rank q * (count - 1) in sorted order, counted from 0
+    double rank = q * (count - 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) return valueOf(first + i);
+    }
+    return valueOf(first + buckets.size() - 1);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+///quantiles come out within this fraction of a value actually added
+#define SKETCH_ACCURACY 0.01
+
+///a histogram over logarithmic buckets: memory grows with the logarithm of
+///the largest value only, no matter how many are added, and two sketches
+///merge by adding up their buckets
+class Sketch {
+    ///the bucket of 0 is 0, the one of v > 0 is 1 + ceil(log_gamma(v))
+    std::vector<uint32_t> buckets;
+    unsigned first = 0;
+    uint32_t count = 0;
+
+public:
+    Sketch() = default;
+    ///the sketch whose buckets from first on hold counts
+    Sketch(unsigned first, std::vector<uint32_t> counts);
+
+    void add(uint32_t value);
+    void merge(const Sketch &other);
+    void clear();
+
+    ///a value within SKETCH_ACCURACY of the q-quantile, 0 if empty
+    uint32_t quantile(double q) const;
+    uint32_t getCount() const { return count; }
+    unsigned getFirst() const { return first; }
+    const std::vector<uint32_t> &getBuckets() const { return buckets; }
+};
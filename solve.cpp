@@ -0,0 +1,70 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "solver.hpp"
+
+static const char *placeName(Place place) {
+    static char buf[16];
+    switch (place.index()) {
+    case 0:
+        snprintf(buf, sizeof(buf), "row %d", std::get<Row>(place).idx);
+        break;
+    case 1:
+        snprintf(buf, sizeof(buf), "extra %d", std::get<Extra>(place).idx);
+        break;
+    case 2:
+        snprintf(buf, sizeof(buf), "cellar");
+        break;
+    default:
+        snprintf(buf, sizeof(buf), "pile %d", std::get<Pile>(place).idx);
+        break;
+    }
+    return buf;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [deal] [--table-mb N] [--nodes N]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    unsigned long number = 0;
+    size_t table_mb = 64;
+    uint64_t node_limit = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--table-mb") && i + 1 < argc) {
+            table_mb = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+            node_limit = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-') {
+            number = strtoul(argv[i], nullptr, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    Position position;
+    position.deal((uint64_t)number);
+    Solver solver(table_mb << 20, node_limit);
+    auto start = std::chrono::steady_clock::now();
+    Solver::Result result = solver.solve(position);
+    auto end = std::chrono::steady_clock::now();
+    printf("deal      %lu\n"
+           "result    %s\n"
+           "nodes     %llu\n"
+           "time      %.3fs\n"
+           "position  %zu bytes\n"
+           "table     %zu bytes\n",
+            number, resultName(result), (unsigned long long)solver.getNodes(),
+            std::chrono::duration<double>(end - start).count(),
+            sizeof(Position), solver.getTableBytes());
+    for (const Move &move : solver.getSolution()) {
+        printf("%s -> ", placeName(move.from));
+        printf("%s", placeName(move.to));
+        if (move.size > 1) {
+            printf(" (%u cards%s)", move.size, move.reversed ? ", reversed" : "");
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include "solver.hpp"
+
+const char *resultName(Solver::Result result) {
+    switch (result) {
+    case Solver::Result::Winnable:
+        return "winnable";
+    case Solver::Result::Unwinnable:
+        return "unwinnable";
+    default:
+        return "unknown";
+    }
+}
+
+///moving a whole row into a vacant one gets us nowhere
+static bool pointless(const Position &position, const Move &move) {
+    return !move.reversed
+        && std::holds_alternative<Row>(move.from)
+        && std::holds_alternative<Row>(move.to)
+        && position.size(move.to) == 0
+        && position.size(move.from) == move.size;
+}
+
+Solver::Solver(size_t table_bytes, uint64_t node_limit)
+    : node_limit(node_limit)
+{
+    size_t buckets = std::bit_floor(std::max<size_t>(table_bytes / (BUCKET_SIZE * sizeof(Entry)), 1));
+    table.resize(buckets * BUCKET_SIZE);
+    mask = buckets - 1;
+}
+
+Solver::Entry *Solver::find(uint64_t key) {
+    Entry *bucket = &table[(key & mask) * BUCKET_SIZE];
+    for (unsigned i = 0; i < BUCKET_SIZE; ++i) {
+        if (bucket[i].key == key && bucket[i].generation == generation) {
+            return &bucket[i];
+        }
+    }
+    return nullptr;
+}
+
+Solver::Entry *Solver::insert(uint64_t key) {
+    Entry *bucket = &table[(key & mask) * BUCKET_SIZE];
+    Entry *victim = nullptr;
+    for (unsigned i = 0; i < BUCKET_SIZE; ++i) {
+        Entry &entry = bucket[i];
+        if (entry.generation != generation) {
+            victim = &entry;
+            break;
+        }
+        if (!entry.on_path && (!victim || entry.work < victim->work)) {
+            victim = &entry;
+        }
+    }
+    if (victim) {
+        *victim = {key, 0, generation, true};
+    }
+    return victim;
+}
+
+Solver::Visit Solver::visit(Position &position, const CanonicalHash &canonical) {
+    if ((node_limit && nodes >= node_limit) || (stop && stop->load(std::memory_order_relaxed))) {
+        aborted = true;
+        return Visit::Skip;
+    }
+    ++nodes;
+    if (position.won()) {
+        return Visit::Win;
+    }
+    uint64_t key = canonical.get();
+    if (find(key)) {
+        return Visit::Skip;
+    }
+    Entry *entry = insert(key);
+    if (!entry && std::find_if(frames.begin(), frames.end(),
+                [&](const Frame &frame) { return frame.key == key; }) != frames.end())
+    {
+        return Visit::Skip;
+    }
+    MoveList candidates;
+    position.generateMoves(candidates);
+    unsigned begin = moves.size();
+    for (const Move &move : candidates) {
+        if (!pointless(position, move)) {
+            moves.push_back(move);
+        }
+    }
+    frames.emplace_back(key, entry, nodes, begin, begin);
+    return Visit::Expand;
+}
+
+bool Solver::search(Position &position) {
+    //follows the position through every move instead of hashing it per node
+    CanonicalHash canonical(position);
+    Visit root = visit(position, canonical);
+    if (root != Visit::Expand) {
+        return root == Visit::Win;
+    }
+    while (!frames.empty()) {
+        Frame &frame = frames.back();
+        if (aborted || frame.next == moves.size()) {
+            if (frame.entry) {
+                assert(frame.entry->key == frame.key);
+                frame.entry->on_path = false;
+                frame.entry->work = std::min<uint64_t>(nodes - frame.nodes_before, UINT32_MAX);
+            }
+            moves.resize(frame.begin);
+            frames.pop_back();
+            if (!frames.empty()) {
+                canonical.update(position, solution.back(), true);
+                position.revert(solution.back());
+                solution.pop_back();
+            }
+            continue;
+        }
+        Move move = moves[frame.next++];
+        canonical.update(position, move);
+        position.apply(move);
+        solution.push_back(move);
+        Visit visited = visit(position, canonical);
+        if (visited == Visit::Win) {
+            return true;
+        }
+        if (visited == Visit::Skip) {
+            canonical.update(position, move, true);
+            position.revert(move);
+            solution.pop_back();
+        }
+    }
+    return false;
+}
+
+Solver::Result Solver::solve(const Position &position, const std::atomic<bool> *stop) {
+    //entries of earlier searches count as empty, so the table needn't be cleared
+    if (++generation == 0) {
+        std::fill(table.begin(), table.end(), Entry());
+        generation = 1;
+    }
+    this->stop = stop;
+    nodes = 0;
+    aborted = false;
+    solution.clear();
+    frames.clear();
+    moves.clear();
+    Position copy = position;
+    if (search(copy)) {
+        return Result::Winnable;
+    }
+    return aborted ? Result::Unknown : Result::Unwinnable;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "rules.hpp"
+
+///depth first search over all legal moves, remembering explored positions
+///in a transposition table of fixed size
+class Solver {
+    struct Entry {
+        uint64_t key;
+        ///nodes spent below this position, the cheapest entry is replaced first
+        uint32_t work;
+        ///entries of earlier searches count as empty
+        uint16_t generation;
+        ///entries of positions on the current path are never replaced
+        bool on_path;
+    };
+
+    struct Frame {
+        uint64_t key;
+        ///null if the table had no room, the path is searched instead
+        Entry *entry;
+        uint64_t nodes_before;
+        ///this frame's moves start at moves[begin], the ones left to try at
+        ///moves[next]
+        unsigned begin;
+        unsigned next;
+    };
+
+    enum class Visit { Win, Skip, Expand };
+
+    static constexpr unsigned BUCKET_SIZE = 4;
+
+    std::vector<Entry> table;
+    uint64_t mask;
+    uint64_t node_limit;
+    const std::atomic<bool> *stop = nullptr;
+    uint64_t nodes = 0;
+    uint16_t generation = 0;
+    bool aborted = false;
+    std::vector<Move> solution;
+    ///the current path, iterative because winning lines can be very long
+    std::vector<Frame> frames;
+    ///the candidate moves of all frames on the path, one after another
+    std::vector<Move> moves;
+
+    Entry *find(uint64_t key);
+    Entry *insert(uint64_t key);
+    Visit visit(Position &position, const CanonicalHash &canonical);
+    bool search(Position &position);
+
+public:
+    enum class Result { Winnable, Unwinnable, Unknown };
+
+    ///table_bytes is rounded down to a power of two number of buckets,
+    ///a node_limit of 0 searches until the question is settled
+    explicit Solver(size_t table_bytes = 64 << 20, uint64_t node_limit = 0);
+
+    ///gives up with Unknown as soon as stop is set, which may happen from
+    ///another thread
+    Result solve(const Position &position, const std::atomic<bool> *stop = nullptr);
+
+    ///moves from the solved position to a win, if it is winnable
+    const std::vector<Move> &getSolution() const { return solution; }
+    uint64_t getNodes() const { return nodes; }
+    size_t getTableBytes() const { return table.size() * sizeof(Entry); }
+};
+
+const char *resultName(Solver::Result result);
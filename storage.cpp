@@ -0,0 +1,63 @@
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <filesystem>
+#include <string>
+#include "storage.hpp"
+
+void put(unsigned char *&p, uint64_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) {
+        *p++ = value >> 8 * i;
+    }
+}
+
+uint64_t get(const unsigned char *&p, unsigned bytes) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < bytes; ++i) {
+        value |= (uint64_t)*p++ << 8 * i;
+    }
+    return value;
+}
+
+void append(std::vector<unsigned char> &data, uint64_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) {
+        data.push_back(value >> 8 * i);
+    }
+}
+
+uint32_t checksum(const unsigned char *data, size_t size) {
+    uint32_t h = 2166136261;
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ data[i]) * 16777619;
+    }
+    return h;
+}
+
+bool sync(FILE *f) {
+    if (std::fflush(f)) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+bool writeAtomically(const char *filename, const std::vector<unsigned char> &data) {
+    std::string tmp = std::string(filename) + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size() && sync(f);
+    ok = std::fclose(f) == 0 && ok;
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(tmp, filename, ec);
+    }
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
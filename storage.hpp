@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//everything on disk is little endian with explicit sizes, so that the files
+//don't depend on struct layout or on the machine that wrote them
+
+void put(unsigned char *&p, uint64_t value, unsigned bytes);
+uint64_t get(const unsigned char *&p, unsigned bytes);
+void append(std::vector<unsigned char> &data, uint64_t value, unsigned bytes);
+
+///get that stops at the end of the data: once a field would run past it,
+///it and every later one read as 0 and the reader has failed
+struct Reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    bool failed = false;
+
+    uint64_t get(unsigned bytes) {
+        if (failed || (size_t)(end - p) < bytes) {
+            failed = true;
+            return 0;
+        }
+        return ::get(p, bytes);
+    }
+};
+
+///FNV-1a of size bytes at data
+uint32_t checksum(const unsigned char *data, size_t size);
+
+///flushes f all the way to the disk
+bool sync(FILE *f);
+///replaces filename by data as a whole or, if it fails, not at all: data is
+///written aside, synced and renamed over it
+bool writeAtomically(const char *filename, const std::vector<unsigned char> &data);
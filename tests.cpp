@@ -0,0 +1,509 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "replay.hpp"
+#include "rules.hpp"
+#include "save.hpp"
+#include "sketch.hpp"
+#include "solver.hpp"
+
+#define NUM_POSITIONS 20000
+#define TABLE_BYTES   (4 << 20)
+
+static unsigned long failures;
+
+///reports cond if it doesn't hold and goes on with the test
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while (0)
+
+static bool sameMoves(const MoveList &a, const MoveList &b) {
+    if (a.size() != b.size()) return false;
+    for (unsigned i = 0; i < a.size(); ++i) {
+        const Move &x = a[i], &y = b[i];
+        if (!same(x.from, y.from) || !same(x.to, y.to) || x.size != y.size || x.reversed != y.reversed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+///every kernel the CPU has finds the same moves as the scalar one, in
+///positions from random games
+static void testFitKernels() {
+    FitKernel best = currentFitKernel();
+    Random random(0);
+    uint64_t number = 0;
+    unsigned positions = 0;
+    //one mismatch is enough to go on
+    while (positions < NUM_POSITIONS && !failures) {
+        Position position;
+        position.deal(number++);
+        for (unsigned i = 0; i < 200 && positions < NUM_POSITIONS; ++i, ++positions) {
+            MoveList expected;
+            useFitKernel(FitKernel::Scalar);
+            position.generateMoves(expected);
+            for (FitKernel kernel : {FitKernel::Sse2, FitKernel::Avx2}) {
+                if (!useFitKernel(kernel)) continue;
+                MoveList moves;
+                position.generateMoves(moves);
+                CHECK(sameMoves(moves, expected));
+            }
+            if (expected.size() == 0) break;
+            position.apply(expected[random.below(expected.size())]);
+        }
+    }
+    useFitKernel(best);
+}
+
+///the solutions of winnable deals are legal and win, and a deal that can't
+///be won is settled as such
+static void testSolver() {
+    Solver solver(TABLE_BYTES);
+    for (uint64_t number : {1, 2, 3, 7}) {
+        Position position;
+        position.deal(number);
+        CHECK(solver.solve(position) == Solver::Result::Winnable);
+        for (const Move &move : solver.getSolution()) {
+            CHECK(position.isLegal(move));
+            position.apply(move);
+        }
+        CHECK(position.won());
+    }
+    for (uint64_t number : {11, 16}) {
+        Position position;
+        position.deal(number);
+        CHECK(solver.solve(position) == Solver::Result::Unwinnable);
+    }
+}
+
+///positions from random games, so that they are spread over all stages
+static std::vector<Position> samplePositions(unsigned count) {
+    std::vector<Position> positions;
+    Random random(0);
+    uint64_t number = 0;
+    while (positions.size() < count) {
+        Position position;
+        position.deal(number++);
+        MoveList moves;
+        for (unsigned i = 0; i < 200 && positions.size() < count; ++i) {
+            positions.push_back(position);
+            position.generateMoves(moves);
+            if (moves.size() == 0) break;
+            position.apply(moves[random.below(moves.size())]);
+        }
+    }
+    return positions;
+}
+
+///position with the places of each kind in another order and the suits
+///relabelled; the hashes and facts are left alone
+static Position shuffled(const Position &position, Random &random) {
+    std::array<char, NUM_PLACES> order;
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        order[i] = i;
+    }
+    random.shuffle(std::span(order.begin(), NUM_ROWS));
+    random.shuffle(std::span(order.begin() + NUM_ROWS, NUM_EXTRA));
+    random.shuffle(std::span(order.begin() + NUM_VACANT, NUM_PILES));
+    std::array<char, NUM_PILES> suits = {0, 1, 2, 3};
+    random.shuffle(suits);
+    Position result = position;
+    result.start[0] = 0;
+    for (unsigned i = 0; i < NUM_PLACES; ++i) {
+        unsigned next = result.start[i];
+        for (unsigned j = position.start[order[i]]; j < position.start[order[i] + 1]; ++j) {
+            char card = position.cards[j];
+            result.cards[next++] = suits[CARD_INFO[card].suit] * CARDS_PER_SUIT + CARD_INFO[card].rank;
+        }
+        result.start[i + 1] = next;
+    }
+    return result;
+}
+
+///the hash kept up to date by every move is the one computed from scratch,
+///which release builds don't assert
+static void testIncrementalHash() {
+    for (const Position &position : samplePositions(NUM_POSITIONS)) {
+        CHECK(position.getHash() == position.computeHash());
+    }
+}
+
+///generateMoves lists every move isLegal accepts exactly once, and never
+///more than MAX_MOVES of them
+static void testGenerateMoves() {
+    auto key = [](const Move &move) {
+        return ((placeIndex(move.from) * NUM_PLACES + placeIndex(move.to)) * (NUM_CARDS + 1) + move.size) * 2
+            + move.reversed;
+    };
+    for (const Position &position : samplePositions(NUM_POSITIONS)) {
+        MoveList moves;
+        position.generateMoves(moves);
+        CHECK(moves.size() <= MAX_MOVES);
+        std::vector<bool> generated(NUM_PLACES * NUM_PLACES * (NUM_CARDS + 1) * 2);
+        for (const Move &move : moves) {
+            CHECK(position.isLegal(move));
+            CHECK(!generated[key(move)]);
+            generated[key(move)] = true;
+        }
+        unsigned legal = 0;
+        for (Place from : PLACES) {
+            for (Place to : PLACES) {
+                for (unsigned size = 1; size <= position.size(from); ++size) {
+                    for (bool reversed : {false, true}) {
+                        Move move{from, size, to, reversed};
+                        if (!position.isLegal(move)) continue;
+                        CHECK(generated[key(move)]);
+                        ++legal;
+                    }
+                }
+            }
+        }
+        CHECK(legal == moves.size());
+    }
+}
+
+///the canonical hash ignores the order of places of a kind and which suit
+///is which, tells apart positions that differ otherwise, and follows moves
+static void testCanonicalHash() {
+    Random random(1);
+    for (const Position &position : samplePositions(NUM_POSITIONS / 10)) {
+        uint64_t key = position.canonicalHash();
+        CHECK(shuffled(position, random).canonicalHash() == key);
+        MoveList moves;
+        position.generateMoves(moves);
+        for (const Move &move : moves) {
+            //a whole row moved into a vacant one is the same position
+            bool same_position = !move.reversed && position.size(move.to) == 0
+                && std::holds_alternative<Row>(move.from) && std::holds_alternative<Row>(move.to)
+                && position.size(move.from) == move.size;
+            Position next = position;
+            CanonicalHash canonical(next);
+            canonical.update(next, move);
+            next.apply(move);
+            CHECK(canonical.get() == next.canonicalHash());
+            CHECK(same_position == (canonical.get() == key));
+            canonical.update(next, move, true);
+            CHECK(canonical.get() == key);
+        }
+    }
+}
+
+///deal numbers kept in replays and saves have to give the same layout on
+///every platform and in every version, so that they can be played again
+static void testDealLayouts() {
+    struct Layout {
+        uint64_t number;
+        std::array<char, NUM_CARDS> cards;
+    };
+    static const Layout LAYOUTS[] = {
+        {0, {17, 12, 6, 35, 45, 19, 31, 10, 26, 3, 47, 30, 27, 23, 25, 16, 1, 15, 9, 2, 32, 24, 34, 18, 5, 21,
+             40, 41, 22, 8, 36, 14, 39, 37, 51, 43, 50, 29, 42, 4, 11, 48, 28, 13, 0, 49, 44, 38, 7, 20, 33, 46}},
+        {1, {10, 38, 51, 3, 14, 21, 45, 43, 18, 28, 16, 20, 31, 41, 49, 27, 36, 15, 0, 33, 12, 19, 25, 32, 8, 2,
+             7, 23, 29, 37, 17, 34, 44, 6, 5, 1, 39, 42, 47, 24, 30, 46, 11, 13, 40, 4, 50, 26, 9, 22, 35, 48}},
+        {12345, {16, 37, 47, 46, 31, 51, 28, 44, 36, 3, 5, 33, 43, 24, 42, 0, 15, 45, 38, 19, 27, 11, 7, 14, 4, 2,
+                 40, 8, 39, 30, 17, 34, 1, 25, 20, 23, 49, 32, 21, 41, 50, 13, 26, 10, 29, 18, 12, 6, 9, 22, 35, 48}},
+        {1ull << 40, {4, 40, 47, 19, 8, 25, 24, 10, 18, 13, 48, 37, 12, 42, 34, 31, 45, 23, 38, 5, 39, 3, 17, 9, 0, 22,
+                      21, 50, 1, 35, 43, 27, 6, 32, 49, 14, 26, 15, 11, 16, 2, 36, 29, 30, 41, 28, 44, 51, 7, 20, 33, 46}},
+    };
+    for (const Layout &layout : LAYOUTS) {
+        Position position;
+        position.deal(layout.number);
+        CHECK(position.cards == layout.cards);
+    }
+}
+
+///jumping is the same from the same state, moves along the same sequence,
+///so that it commutes with drawing, and gives streams that don't overlap
+static void testRandomJump() {
+    Random a(42), b(42);
+    a.jump();
+    b.jump();
+    for (unsigned i = 0; i < 1000; ++i) {
+        CHECK(a.next() == b.next());
+    }
+    Random c(42), d(42);
+    c.next();
+    c.jump();
+    d.jump();
+    d.next();
+    CHECK(c.next() == d.next());
+    //streams that overlapped within their first numbers would share some
+    std::vector<uint64_t> drawn;
+    Random stream(42);
+    for (unsigned k = 0; k < 4; ++k) {
+        Random copy = stream;
+        for (unsigned i = 0; i < 1 << 16; ++i) {
+            drawn.push_back(copy.next());
+        }
+        stream.jump();
+    }
+    std::sort(drawn.begin(), drawn.end());
+    CHECK(std::adjacent_find(drawn.begin(), drawn.end()) == drawn.end());
+}
+
+static bool sameSketch(const Sketch &a, const Sketch &b) {
+    return a.getCount() == b.getCount() && a.getFirst() == b.getFirst() && a.getBuckets() == b.getBuckets();
+}
+
+///quantiles of a sketch are within SKETCH_ACCURACY of the exact ones, and
+///merging sketches of two parts gives the sketch of the whole
+static void testSketch() {
+    Random random(5);
+    std::vector<uint32_t> values;
+    //spread over many orders of magnitude, with ties and both extremes
+    for (unsigned i = 0; i < 100000; ++i) {
+        values.push_back((uint64_t)random.below(1 << 16) * random.below(1 << 16) >> random.below(32));
+    }
+    values.push_back(0);
+    values.push_back(UINT32_MAX);
+    Sketch whole, low, high;
+    std::vector<uint32_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    uint32_t median = sorted[sorted.size() / 2];
+    for (uint32_t value : values) {
+        whole.add(value);
+        (value < median ? low : high).add(value);
+    }
+    CHECK(whole.getCount() == values.size());
+    for (unsigned percent = 0; percent <= 100; ++percent) {
+        double q = percent / 100.0;
+        double exact = sorted[(size_t)(q * (sorted.size() - 1))];
+        //rounding to a whole number adds at most a half
+        CHECK(std::abs(whole.quantile(q) - exact) <= SKETCH_ACCURACY * exact + 0.5);
+    }
+    Sketch merged = low;
+    merged.merge(high);
+    CHECK(sameSketch(merged, whole));
+    merged = high;
+    merged.merge(low);
+    CHECK(sameSketch(merged, whole));
+    merged = Sketch();
+    merged.merge(whole);
+    merged.merge(Sketch());
+    CHECK(sameSketch(merged, whole));
+}
+
+///runs body in an empty directory of its own, for the code that keeps its
+///files in the working directory
+template<typename F>
+static void inTempDir(const char *name, F body) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::filesystem::path cwd = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+    body();
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+}
+
+static std::vector<char> readFile(const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), {}};
+}
+
+static void writeFile(const char *filename, const std::vector<char> &data) {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+static GameRecord lostGame(const Config &config) {
+    GameRecord record = {};
+    record.config = config;
+    return record;
+}
+
+///a crash after compacting wrote the snapshot but before it reset the
+///journal leaves the old journal behind; the games after it still count
+static void testStaleJournal() {
+    inTempDir("little-napoleon-tests", [] {
+        Config config;
+        uint32_t losses = 0;
+        {
+            //enough games that the next load compacts
+            Statistic stats;
+            stats.load(config);
+            for (; losses < 300; ++losses) {
+                stats.record(lostGame(config));
+            }
+        }
+        std::vector<char> journal = readFile(JOURNAL_FILE);
+        {
+            Statistic stats;
+            stats.load(config);
+            CHECK(stats.losses == losses);
+        }
+        writeFile(JOURNAL_FILE, journal);
+        {
+            Statistic stats;
+            stats.load(config);
+            CHECK(stats.losses == losses);
+            stats.record(lostGame(config));
+            stats.record(lostGame(config));
+            losses += 2;
+        }
+        for (int i = 0; i < 2; ++i) {
+            Statistic stats;
+            stats.load(config);
+            CHECK(stats.losses == losses);
+        }
+    });
+}
+
+///data with its last 4 bytes set to the checksum of the rest, the way the
+///snapshot ends
+static std::vector<char> sealed(std::vector<char> data) {
+    uint32_t h = 2166136261;
+    for (size_t i = 0; i + 4 < data.size(); ++i) {
+        h = (h ^ (unsigned char)data[i]) * 16777619;
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        data[data.size() - 4 + i] = h >> 8 * i;
+    }
+    return data;
+}
+
+///a damaged snapshot is thrown away rather than read past its end, and the
+///games of the journal still count
+static void testBadSnapshot() {
+    inTempDir("little-napoleon-tests", [] {
+        Config config;
+        {
+            Statistic stats;
+            stats.load(config);
+            for (unsigned i = 0; i < 300; ++i) {
+                stats.record(lostGame(config));
+            }
+        }
+        {
+            //folds the games into the snapshot, then two more in the journal
+            Statistic stats;
+            stats.load(config);
+            stats.record(lostGame(config));
+            stats.record(lostGame(config));
+        }
+        std::vector<char> snapshot = readFile(SNAPSHOT_FILE);
+        std::vector<char> journal = readFile(JOURNAL_FILE);
+        std::vector<std::vector<char>> damaged;
+        //cut short anywhere after the header, or with a count far too high
+        for (size_t size = 20; size < snapshot.size(); size += 7) {
+            std::vector<char> cut(snapshot.begin(), snapshot.begin() + size);
+            damaged.push_back(sealed(cut));
+        }
+        std::vector<char> huge = snapshot;
+        std::memset(&huge[16], 0xff, 4);
+        damaged.push_back(sealed(huge));
+        std::vector<char> longer = snapshot;
+        longer.insert(longer.end() - 4, 8, 0);
+        damaged.push_back(sealed(longer));
+        std::vector<char> flipped = snapshot;
+        flipped[20] ^= 1;
+        damaged.push_back(flipped);
+        for (const std::vector<char> &data : damaged) {
+            writeFile(SNAPSHOT_FILE, data);
+            writeFile(JOURNAL_FILE, journal);
+            for (int i = 0; i < 2; ++i) {
+                Statistic stats;
+                stats.load(config);
+                CHECK(stats.losses == 2);
+            }
+        }
+    });
+}
+
+///a replay torn by a crash is cut off by the next append, so that the
+///replays after it can be read
+static void testTornReplay() {
+    inTempDir("little-napoleon-tests", [] {
+        Replay replay = {};
+        replay.deal = 1;
+        replay.moves.push_back(Move(Row(0), 1, Cellar(), false));
+        ReplayLog log(REPLAY_FILE);
+        CHECK(log.append(replay));
+        size_t whole = std::filesystem::file_size(REPLAY_FILE);
+        CHECK(log.append(replay));
+        std::filesystem::resize_file(REPLAY_FILE, 2 * whole - 8 - 3);
+        CHECK(log.append(replay));
+        //a log of its own finds the same end
+        std::filesystem::resize_file(REPLAY_FILE, 2 * whole - 8 - 3);
+        CHECK(ReplayLog(REPLAY_FILE).append(replay));
+        size_t unread;
+        CHECK(readReplays(REPLAY_FILE, unread).size() == 2);
+        CHECK(unread == 0);
+        CHECK(std::filesystem::file_size(REPLAY_FILE) == 2 * whole - 8);
+    });
+}
+
+///a save that fails leaves the one before it as it was
+static void testFailedSave() {
+    inTempDir("little-napoleon-tests", [] {
+        SaveState state = {};
+        state.header.deal = 1;
+        state.header.position.deal(1);
+        CHECK(writeSave(SAVE_FILE, state));
+        //nothing can be written aside, so nothing may be replaced
+        std::filesystem::create_directory(SAVE_FILE ".tmp");
+        state.header.deal = 2;
+        CHECK(!writeSave(SAVE_FILE, state));
+        std::optional<SaveState> read = readSave(SAVE_FILE);
+        CHECK(read && read->header.deal == 1);
+        std::filesystem::remove(SAVE_FILE ".tmp");
+        CHECK(writeSave(SAVE_FILE, state));
+        read = readSave(SAVE_FILE);
+        CHECK(read && read->header.deal == 2);
+        CHECK(!std::filesystem::exists(SAVE_FILE ".tmp"));
+    });
+}
+
+struct Test {
+    const char *name;
+    void (*run)();
+};
+
+static const Test TESTS[] = {
+    {"fit_kernels", testFitKernels},
+    {"solver", testSolver},
+    {"deal_layouts", testDealLayouts},
+    {"random_jump", testRandomJump},
+    {"incremental_hash", testIncrementalHash},
+    {"generate_moves", testGenerateMoves},
+    {"canonical_hash", testCanonicalHash},
+    {"sketch", testSketch},
+    {"stale_journal", testStaleJournal},
+    {"bad_snapshot", testBadSnapshot},
+    {"torn_replay", testTornReplay},
+    {"failed_save", testFailedSave},
+};
+
+int main(int argc, char **argv) {
+    unsigned long ran = 0;
+    for (const Test &test : TESTS) {
+        bool wanted = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            wanted |= !strcmp(argv[i], test.name);
+        }
+        if (!wanted) continue;
+        unsigned long before = failures;
+        test.run();
+        printf("%-16s %s\n", test.name, failures == before ? "ok" : "FAILED");
+        ++ran;
+    }
+    if (ran == 0) {
+        fprintf(stderr, "usage: %s [test...]\n", argv[0]);
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "replay.hpp"
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [file] [--all]\n", name);
+    exit(1);
+}
+
+static void print(unsigned long index, const Replay &replay, const char *verdict) {
+    unsigned real_moves = 0;
+    for (const Move &move : replay.moves) {
+        real_moves += realMoves(move);
+    }
+    char finished[32];
+    time_t time = replay.finished;
+    strftime(finished, sizeof(finished), "%Y-%m-%d %H:%M:%S", localtime(&time));
+    printf("%-6lu deal %-20llu %s  %-4s %4zu moves %4u real  %s\n",
+            index, (unsigned long long)replay.deal, finished,
+            replay.won ? "won" : "lost", replay.moves.size(), real_moves,
+            verdict ? verdict : "ok");
+}
+
+int main(int argc, char **argv) {
+    const char *filename = REPLAY_FILE;
+    bool all = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--all")) {
+            all = true;
+        } else if (argv[i][0] != '-') {
+            filename = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t unread;
+    std::vector<Replay> replays = readReplays(filename, unread);
+    unsigned long bad = 0;
+    size_t moves = 0;
+    for (size_t i = 0; i < replays.size(); ++i) {
+        const char *verdict = verifyReplay(replays[i]);
+        bad += verdict != nullptr;
+        moves += replays[i].moves.size();
+        if (verdict || all) {
+            print(i, replays[i], verdict);
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("replays   %zu\n"
+           "bad       %lu\n"
+           "unread    %zu bytes\n"
+           "moves     %zu\n"
+           "time      %.3fs\n"
+           "rate      %.0f/s\n",
+            replays.size(), bad, unread, moves, secs, replays.size() / secs);
+    return bad || unread ? 1 : 0;
+}